@@ -0,0 +1,373 @@
+// Microbenchmarks of the hot functions, run in isolation over generated corpora.
+//
+//   simple_blog_bench [--sizes=10,100,...] [--min-time=SECONDS] [--content-bytes=N] [--filter=SUBSTRING]
+//
+// Prints one JSON document on stdout with ns/op, allocations/op and bytes allocated/op per
+// benchmark and corpus size, plus measured sizes (index memory), progress goes to stderr.
+
+#include "../definentions.hpp"
+#include "../library/web-lib.hpp"
+#include "../routes/routes.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include <unistd.h>
+
+// Every allocation in the process is counted, the numbers are read around the timed loop
+static std::atomic<uint64_t> allocation_count{0};
+static std::atomic<uint64_t> allocated_bytes{0};
+
+void *operator new(size_t size)
+{
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+struct bench_options
+{
+    std::vector<size_t> sizes = {10, 100, 1000, 10000, 100000, 1000000};
+    double min_time = 0.25;
+    size_t content_bytes = 256;
+    std::string filter;
+};
+
+// A size measured once rather than timed, e.g. memory held by an index
+struct bench_value
+{
+    std::string name;
+    size_t corpus;
+    uint64_t bytes;
+};
+
+struct bench_result
+{
+    std::string name;
+    size_t corpus;
+    uint64_t iterations;
+    double ns_per_op;
+    double allocs_per_op;
+    double bytes_per_op;
+};
+
+// Keeps results alive so the compiler cannot drop the benchmarked call
+static volatile size_t sink;
+
+class Bench
+{
+    bench_options options;
+    std::vector<bench_result> results;
+    std::vector<bench_value> values;
+
+public:
+    explicit Bench(bench_options options) : options(std::move(options)) {}
+
+    // Runs op until min_time has passed, op returns a size that is fed to the sink
+    template <typename Op>
+    void run(const std::string &name, size_t corpus, Op op)
+    {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            return;
+
+        using clock = std::chrono::steady_clock;
+
+        // Warm up once (first calls build static tables), then time one run to size the loop
+        sink = op();
+        auto warm_start = clock::now();
+        sink = op();
+        double warm_ns = std::chrono::duration<double, std::nano>(clock::now() - warm_start).count();
+
+        uint64_t iterations = 1;
+        if (warm_ns > 0)
+            iterations = static_cast<uint64_t>(options.min_time * 1e9 / warm_ns);
+        iterations = std::max<uint64_t>(1, std::min<uint64_t>(iterations, 10000000));
+
+        uint64_t allocs_before = allocation_count.load(std::memory_order_relaxed);
+        uint64_t bytes_before = allocated_bytes.load(std::memory_order_relaxed);
+        auto start = clock::now();
+        for (uint64_t i = 0; i < iterations; i++)
+        {
+            sink = op();
+        }
+        double elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+        uint64_t allocs = allocation_count.load(std::memory_order_relaxed) - allocs_before;
+        uint64_t bytes = allocated_bytes.load(std::memory_order_relaxed) - bytes_before;
+
+        bench_result result{name, corpus, iterations, elapsed_ns / iterations,
+                            static_cast<double>(allocs) / iterations, static_cast<double>(bytes) / iterations};
+        std::cerr << name << " corpus=" << corpus << ": " << result.ns_per_op << " ns/op, "
+                  << result.allocs_per_op << " allocs/op" << std::endl;
+        results.push_back(result);
+    }
+
+    void record(const std::string &name, size_t corpus, uint64_t bytes)
+    {
+        if (!options.filter.empty() && name.find(options.filter) == std::string::npos)
+            return;
+        std::cerr << name << " corpus=" << corpus << ": " << bytes << " bytes" << std::endl;
+        values.push_back({name, corpus, bytes});
+    }
+
+    std::string to_json() const
+    {
+        std::string out = "{\"context\":{\"min_time_seconds\":" + std::to_string(options.min_time) +
+                          ",\"content_bytes\":" + std::to_string(options.content_bytes) + "},\"benchmarks\":[";
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            const auto &r = results[i];
+            char numbers[160];
+            std::snprintf(numbers, sizeof(numbers), ",\"iterations\":%llu,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f}",
+                          static_cast<unsigned long long>(r.iterations), r.ns_per_op, r.allocs_per_op, r.bytes_per_op);
+            if (i > 0)
+                out += ',';
+            out += "\n{\"name\":\"" + r.name + "\",\"corpus\":" + std::to_string(r.corpus) + numbers;
+        }
+        out += "\n],\"values\":[";
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            const auto &v = values[i];
+            if (i > 0)
+                out += ',';
+            out += "\n{\"name\":\"" + v.name + "\",\"corpus\":" + std::to_string(v.corpus) + ",\"bytes\":" + std::to_string(v.bytes) + "}";
+        }
+        out += "\n]}";
+        return out;
+    }
+};
+
+// Deterministic blogs with ids 1..count, text sized like a real post
+std::vector<Blog> make_corpus(size_t count, size_t content_bytes)
+{
+    static const char *words[] = {"server", "request", "latency", "blog", "template", "socket", "router",
+                                  "cache", "json", "header", "thread", "buffer", "parser", "index"};
+    std::mt19937 rng(42);
+    auto text = [&](size_t bytes)
+    {
+        std::string out;
+        while (out.size() < bytes)
+        {
+            if (!out.empty())
+                out += ' ';
+            out += words[rng() % (sizeof(words) / sizeof(words[0]))];
+        }
+        return out;
+    };
+
+    std::vector<Blog> blogs;
+    blogs.reserve(count);
+    for (size_t i = 1; i <= count; i++)
+    {
+        blogs.emplace_back(static_cast<int>(i), text(48), text(content_bytes), text(content_bytes / 4), "2025-01-01 12:00:00");
+    }
+    return blogs;
+}
+
+bool parse_options(int argc, char *argv[], bench_options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--sizes=", 0) == 0)
+        {
+            options.sizes.clear();
+            std::string list = arg.substr(8);
+            size_t pos = 0;
+            while (pos < list.size())
+            {
+                size_t comma = list.find(',', pos);
+                options.sizes.push_back(std::stoul(list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos)));
+                pos = comma == std::string::npos ? list.size() : comma + 1;
+            }
+        }
+        else if (arg.rfind("--min-time=", 0) == 0)
+            options.min_time = std::stod(arg.substr(11));
+        else if (arg.rfind("--content-bytes=", 0) == 0)
+            options.content_bytes = std::stoul(arg.substr(16));
+        else if (arg.rfind("--filter=", 0) == 0)
+            options.filter = arg.substr(9);
+        else
+            return false;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_options options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+        {
+            std::cerr << "Usage: " << argv[0] << " [--sizes=10,100,...] [--min-time=SECONDS] [--content-bytes=N] [--filter=SUBSTRING]" << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Invalid option: " << e.what() << std::endl;
+        return 1;
+    }
+
+    char dir_template[] = "/tmp/simple_blog_bench.XXXXXX";
+    if (!mkdtemp(dir_template))
+    {
+        std::cerr << "Cannot create a scratch directory" << std::endl;
+        return 1;
+    }
+    std::string dir = dir_template;
+
+    template_cache().load_directory(CPP_PROJECT_SOURCE_DIR + std::string("views/html"), false);
+
+    Bench bench(options);
+
+    // Request parsing and filtering do not depend on the corpus size
+    {
+        auto blog = make_corpus(1, options.content_bytes).front();
+        std::string form = "title=" + std::string(blog.get_title()) + "&content=" + std::string(blog.get_content()) +
+                           "&preview_content=" + std::string(blog.get_preview_content());
+        std::replace(form.begin(), form.end(), ' ', '+');
+
+        // The same form the way a browser sends punctuation and non-ASCII text
+        std::string encoded_form;
+        for (size_t i = 0; i < form.size(); i++)
+        {
+            encoded_form += form[i];
+            if (form[i] == '+' && i % 3 == 0)
+                encoded_form += "%C3%A9%2C";
+        }
+
+        bench.run("parse_form_data", 0, [&]
+                  { return parse_form_data(form).size(); });
+        bench.run("parse_form_data_encoded", 0, [&]
+                  { return parse_form_data(encoded_form).size(); });
+
+        // A create request with 64 KB of content, parsed whole vs indexed and read field by field
+        std::string json_body = "{\"title\":\"" + std::string(blog.get_title()) + "\",\"content\":\"";
+        while (json_body.size() < 64 * 1024)
+            json_body.append(blog.get_content()).append("\\n\\\"quoted\\\" ");
+        json_body += "\",\"tags\":[\"a\",\"b\"]}";
+
+        bench.run("json_body_parse", 0, [&]
+                  { auto parsed = parse(json_body);
+                    return getter::get_string(parsed["title"]).size() + getter::get_string(parsed["content"]).size(); });
+        bench.run("json_body_index", 0, [&]
+                  { JsonObjectIndex fields(json_body);
+                    std::string title, content;
+                    fields.get_string("title", title);
+                    fields.get_string("content", content);
+                    return title.size() + content.size(); });
+        bench.run("check_body", 0, [&]
+                  { return static_cast<size_t>(body_scanner().is_suspicious(form)); });
+        bench.run("admin_login_view", 0, []
+                  { return admin_login_view().size(); });
+    }
+
+    for (size_t size : options.sizes)
+    {
+        auto corpus = make_corpus(size, options.content_bytes);
+        std::string db_path = dir + "/blogs-" + std::to_string(size) + ".db";
+        std::string save_path = dir + "/saved-" + std::to_string(size) + ".db";
+        Blog::save_blogs_to_file(db_path, corpus);
+        blog_repository().load(db_path);
+
+        std::mt19937 rng(7);
+        auto random_id = [&]
+        { return static_cast<int>(rng() % size) + 1; };
+        const Blog &sample = corpus[size / 2];
+
+        bench.run("load_text_snapshot", size, [&]
+                  { BlogTextFile file;
+                    file.open(db_path);
+                    return file.load_all().size(); });
+        bench.run("load_text_snapshot_1_thread", size, [&]
+                  { BlogTextFile file;
+                    file.open(db_path);
+                    return file.load_all(1).size(); });
+        bench.run("save_blogs_to_file", size, [&]
+                  { Blog::save_blogs_to_file(save_path, corpus); return size; });
+        bench.run("get_blog_by_id", size, [&]
+                  { return static_cast<size_t>(get_blog_by_id(random_id()).get_id()); });
+
+        // Article cards are cached on the entries after the warm-up run, so these time the assembly
+        auto loaded = blog_repository().snapshot();
+        int middle_after = loaded->get_entry_page(-1, size / 2).next_after;
+        bench.run("index_view_first_page", size, [&]
+                  { return index_view(loaded->get_entry_page(-1, INDEX_PAGE_SIZE)).size(); });
+        bench.run("index_view_middle_page", size, [&]
+                  { return index_view(loaded->get_entry_page(middle_after, INDEX_PAGE_SIZE)).size(); });
+        bench.run("index_view_all", size, [&]
+                  { return index_view(loaded->get_entry_page(-1, SIZE_MAX)).size(); });
+        bench.run("article_card_html", size, [&]
+                  { return article_card_html(sample).size(); });
+        bench.run("admin_dashboard_view", size, [&]
+                  { return admin_dashboard_view(corpus).size(); });
+        bench.run("admin_edit_blog_view", size, [&]
+                  { return admin_edit_blog_view(sample).size(); });
+        bench.run("get_single_blog_view", size, [&]
+                  { return get_single_blog_view(sample).size(); });
+
+        bench.run("blog_to_json+stringify", size, [&]
+                  { return blog_to_json(sample)->stringify().size(); });
+        bench.run("blog_to_json_string", size, [&]
+                  { return blog_to_json_string(sample).size(); });
+        // What a read of one blog costs once its renderings are in place
+        const BlogEntry &sample_entry = *loaded->find_entry(sample.get_id());
+        bench.run("cached_blog_page", size, [&]
+                  { return cached_blog_page(sample_entry)->size(); });
+        bench.run("cached_blog_json", size, [&]
+                  { return cached_blog_json(sample_entry)->size(); });
+        bench.run("blogs_to_json+stringify", size, [&]
+                  {
+                      // What /api/blogs built before the streaming writer
+                      auto response_json = std::make_shared<JsonObject>();
+                      auto blogs_array = std::make_shared<JsonArray>();
+                      for (const auto &blog : corpus)
+                          blogs_array->insert(blog_to_json(blog));
+                      response_json->insert("blogs", blogs_array);
+                      response_json->insert("count", maker::make_number(corpus.size()));
+                      return response_json->stringify().size(); });
+        bench.run("blogs_to_json_string", size, [&]
+                  { return blogs_to_json_string(corpus).size(); });
+
+        // The corpus words are in nearly every post, so these are the worst case: every posting is scored
+        std::vector<BlogEntry> loaded_entries;
+        loaded->for_each_entry([&](const BlogEntry &entry)
+                               { loaded_entries.push_back(entry); });
+        bench.run("search_index_build", size, [&]
+                  { SearchIndex index;
+                    index.build(loaded_entries);
+                    return index.size(); });
+        bench.record("search_index_memory", size, blog_repository().get_search_index().memory_bytes());
+        bench.run("search_one_term", size, [&]
+                  { return blog_repository().get_search_index().search("latency", 10).size(); });
+        bench.run("search_two_terms", size, [&]
+                  { return blog_repository().get_search_index().search("cache socket", 10).size(); });
+
+        blog_repository().get_log().close();
+        ::unlink(db_path.c_str());
+        ::unlink((db_path + ".log").c_str());
+        ::unlink(save_path.c_str());
+    }
+    ::rmdir(dir.c_str());
+
+    std::cout << bench.to_json() << std::endl;
+    return 0;
+}
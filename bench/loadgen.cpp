@@ -0,0 +1,827 @@
+// Open-loop HTTP load generator for simple_blog.
+//
+//   simple_blog_loadgen [--host=127.0.0.1] [--port=8080] [--rps=1000] [--duration=10]
+//                       [--connections=64] [--threads=1] [--replay=requests.jsonl]
+//                       [--mix=get:80,post:10,put:5,delete:5] [--token=admin-token-123]
+//
+// Requests are scheduled at a fixed rate whether or not earlier ones have finished. Latency is
+// measured from the time a request was due, not from when a connection was free to send it,
+// so a stalled server shows up in the percentiles instead of silently lowering the send rate
+// (coordinated omission). The uncorrected service time is reported next to it.
+//
+// --replay reads one request per line:
+//   {"method":"POST","path":"/api/blogs","headers":{"Authorization":"Bearer ..."},"body":"..."}
+// and cycles through them. Without it a synthetic mix runs against the routes in routes/routes.hpp,
+// PUT and DELETE only touch blogs that this run created.
+
+#include "../utils/latency_histogram.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using load_clock = std::chrono::steady_clock;
+
+struct loadgen_options
+{
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    double rps = 1000;
+    double duration = 10;
+    int connections = 64;
+    int threads = 1;
+    std::string replay;
+    std::string token = "admin-token-123";
+    int mix_get = 80, mix_post = 10, mix_put = 5, mix_delete = 5;
+};
+
+// ---- Requests ----
+
+struct request_template
+{
+    std::string method;
+    std::string path;
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+};
+
+// Reads a JSON string starting at the opening quote, pos ends after the closing quote
+bool read_json_string(const std::string &text, size_t &pos, std::string &out)
+{
+    if (pos >= text.size() || text[pos] != '"')
+        return false;
+    out.clear();
+    for (pos++; pos < text.size(); pos++)
+    {
+        char c = text[pos];
+        if (c == '"')
+        {
+            pos++;
+            return true;
+        }
+        if (c != '\\')
+        {
+            out += c;
+            continue;
+        }
+        if (++pos >= text.size())
+            return false;
+        switch (text[pos])
+        {
+        case 'n':
+            out += '\n';
+            break;
+        case 'r':
+            out += '\r';
+            break;
+        case 't':
+            out += '\t';
+            break;
+        case 'b':
+            out += '\b';
+            break;
+        case 'f':
+            out += '\f';
+            break;
+        case 'u':
+        {
+            if (pos + 4 >= text.size())
+                return false;
+            unsigned code = std::stoul(text.substr(pos + 1, 4), nullptr, 16);
+            pos += 4;
+            // Basic multilingual plane only, enough for request logs
+            if (code < 0x80)
+                out += static_cast<char>(code);
+            else if (code < 0x800)
+            {
+                out += static_cast<char>(0xC0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else
+            {
+                out += static_cast<char>(0xE0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            break;
+        }
+        default:
+            out += text[pos];
+        }
+    }
+    return false;
+}
+
+void skip_space(const std::string &text, size_t &pos)
+{
+    while (pos < text.size() && std::isspace(static_cast<unsigned char>(text[pos])))
+        pos++;
+}
+
+// Flat {"key":"value",...} object, with one level of nesting for "headers"
+bool parse_replay_line(const std::string &line, request_template &request)
+{
+    size_t pos = 0;
+    skip_space(line, pos);
+    if (pos >= line.size() || line[pos] != '{')
+        return false;
+    pos++;
+
+    while (true)
+    {
+        skip_space(line, pos);
+        if (pos < line.size() && line[pos] == '}')
+            break;
+
+        std::string key, value;
+        if (!read_json_string(line, pos, key))
+            return false;
+        skip_space(line, pos);
+        if (pos >= line.size() || line[pos++] != ':')
+            return false;
+        skip_space(line, pos);
+
+        if (key == "headers" && pos < line.size() && line[pos] == '{')
+        {
+            pos++;
+            while (true)
+            {
+                skip_space(line, pos);
+                if (pos < line.size() && line[pos] == '}')
+                {
+                    pos++;
+                    break;
+                }
+                std::string name, header_value;
+                if (!read_json_string(line, pos, name))
+                    return false;
+                skip_space(line, pos);
+                if (pos >= line.size() || line[pos++] != ':')
+                    return false;
+                skip_space(line, pos);
+                if (!read_json_string(line, pos, header_value))
+                    return false;
+                request.headers.emplace_back(name, header_value);
+                skip_space(line, pos);
+                if (pos < line.size() && line[pos] == ',')
+                    pos++;
+            }
+        }
+        else if (pos < line.size() && line[pos] == '"')
+        {
+            if (!read_json_string(line, pos, value))
+                return false;
+            if (key == "method")
+                request.method = value;
+            else if (key == "path")
+                request.path = value;
+            else if (key == "body")
+                request.body = value;
+        }
+        else
+        {
+            // Numbers, booleans and null of fields we do not use
+            while (pos < line.size() && line[pos] != ',' && line[pos] != '}')
+                pos++;
+        }
+
+        skip_space(line, pos);
+        if (pos < line.size() && line[pos] == ',')
+            pos++;
+        else if (pos >= line.size() || line[pos] != '}')
+            return false;
+    }
+    return !request.method.empty() && !request.path.empty();
+}
+
+std::string serialize_request(const request_template &request, const std::string &host)
+{
+    std::string out = request.method + " " + request.path + " HTTP/1.1\r\nHost: " + host + "\r\nConnection: keep-alive\r\n";
+    for (const auto &[name, value] : request.headers)
+        out += name + ": " + value + "\r\n";
+    if (!request.body.empty() || request.method == "POST" || request.method == "PUT")
+        out += "Content-Length: " + std::to_string(request.body.size()) + "\r\n";
+    out += "\r\n";
+    out += request.body;
+    return out;
+}
+
+// Builds the next request, either from the replay log or from the synthetic mix
+class request_source
+{
+    const loadgen_options &options;
+    std::vector<std::string> replay;
+    size_t replay_next = 0;
+
+    std::mt19937 rng;
+    std::vector<int> created_ids;
+    uint64_t sequence = 0;
+
+    static std::string json_escape(const std::string &value)
+    {
+        std::string out;
+        for (char c : value)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+public:
+    request_source(const loadgen_options &options, const std::vector<std::string> &replay, unsigned seed)
+        : options(options), replay(replay), replay_next(seed % std::max<size_t>(1, replay.size())), rng(seed) {}
+
+    std::string next()
+    {
+        if (!replay.empty())
+        {
+            const std::string &request = replay[replay_next];
+            replay_next = (replay_next + 1) % replay.size();
+            return request;
+        }
+
+        request_template request;
+        std::string auth = "Bearer " + options.token;
+        int total = options.mix_get + options.mix_post + options.mix_put + options.mix_delete;
+        int pick = static_cast<int>(rng() % static_cast<unsigned>(std::max(1, total)));
+        sequence++;
+
+        if (pick >= options.mix_get && pick < options.mix_get + options.mix_post)
+        {
+            request.method = "POST";
+            request.path = "/api/blogs";
+            request.headers = {{"Authorization", auth}, {"Content-Type", "application/json"}};
+            request.body = "{\"title\":\"" + json_escape("Load test post " + std::to_string(sequence)) +
+                           "\",\"content\":\"Generated by simple_blog_loadgen to exercise the write path.\"}";
+        }
+        else if (pick >= options.mix_get + options.mix_post && !created_ids.empty())
+        {
+            size_t index = rng() % created_ids.size();
+            int id = created_ids[index];
+            if (pick < options.mix_get + options.mix_post + options.mix_put)
+            {
+                request.method = "PUT";
+                request.path = "/api/blogs/" + std::to_string(id);
+                request.headers = {{"Authorization", auth}, {"Content-Type", "application/json"}};
+                request.body = "{\"title\":\"Updated post " + std::to_string(id) + "\",\"content\":\"Updated by simple_blog_loadgen.\"}";
+            }
+            else
+            {
+                request.method = "DELETE";
+                request.path = "/api/blogs/" + std::to_string(id);
+                request.headers = {{"Authorization", auth}};
+                created_ids[index] = created_ids.back();
+                created_ids.pop_back();
+            }
+        }
+        else
+        {
+            // Reads, and writes that have nothing of ours to touch yet
+            static const char *read_paths[] = {"/", "/api/blogs", "/api/blogs?limit=20", "/api/blogs/", "/blogs/"};
+            std::string path = read_paths[rng() % 5];
+            if (path.back() == '/' && path.size() > 1)
+                path += std::to_string(created_ids.empty() ? 1 : created_ids[rng() % created_ids.size()]);
+            request.method = "GET";
+            request.path = path;
+        }
+        return serialize_request(request, options.host);
+    }
+
+    // POST responses carry the new blog, later PUTs and DELETEs pick from these
+    void on_created(const std::string &body)
+    {
+        size_t pos = body.find("\"id\":");
+        if (pos == std::string::npos)
+            return;
+        int id = std::atoi(body.c_str() + pos + 5);
+        if (id > 0)
+            created_ids.push_back(id);
+    }
+};
+
+// ---- Connections ----
+
+struct in_flight
+{
+    load_clock::time_point due;
+    load_clock::time_point sent;
+    bool is_post;
+};
+
+struct connection
+{
+    int fd = -1;
+    bool connected = false;
+    std::string out;
+    size_t out_offset = 0;
+    std::string in;
+    bool busy = false;
+    in_flight request{};
+    load_clock::time_point retry_at{}; // set while waiting to reconnect after a refused connect
+};
+
+struct worker_result
+{
+    latency_histogram corrected;
+    latency_histogram uncorrected;
+    uint64_t sent = 0;
+    uint64_t status_classes[6] = {0, 0, 0, 0, 0, 0}; // 1xx..5xx, [0] socket errors
+    uint64_t reconnects = 0;
+};
+
+class worker
+{
+    const loadgen_options &options;
+    request_source source;
+    double rps;
+    int connection_count;
+    sockaddr_in address{};
+    int epoll_fd = -1;
+    std::vector<connection> connections;
+    std::deque<in_flight> backlog; // due but no idle connection yet
+    std::deque<std::string> backlog_requests;
+
+public:
+    worker_result result;
+
+    worker(const loadgen_options &options, const std::vector<std::string> &replay, unsigned seed, double rps, int connection_count)
+        : options(options), source(options, replay, seed), rps(rps), connection_count(connection_count)
+    {
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(options.port));
+        inet_pton(AF_INET, options.host.c_str(), &address.sin_addr);
+    }
+
+    ~worker()
+    {
+        for (auto &conn : connections)
+        {
+            if (conn.fd >= 0)
+                ::close(conn.fd);
+        }
+        if (epoll_fd >= 0)
+            ::close(epoll_fd);
+    }
+
+    void open_connection(size_t index)
+    {
+        connection &conn = connections[index];
+        if (conn.fd >= 0)
+        {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn.fd, nullptr);
+            ::close(conn.fd);
+        }
+        conn = connection();
+        conn.fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+        int one = 1;
+        setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        ::connect(conn.fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+        event.data.u64 = index;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn.fd, &event);
+    }
+
+    void send(size_t index, const in_flight &request, std::string bytes)
+    {
+        connection &conn = connections[index];
+        conn.busy = true;
+        conn.request = request;
+        conn.request.sent = load_clock::now();
+        conn.out = std::move(bytes);
+        conn.out_offset = 0;
+        conn.in.clear();
+        result.sent++;
+        flush(index);
+    }
+
+    void flush(size_t index)
+    {
+        connection &conn = connections[index];
+        while (conn.connected && conn.out_offset < conn.out.size())
+        {
+            ssize_t written = ::send(conn.fd, conn.out.data() + conn.out_offset, conn.out.size() - conn.out_offset, MSG_NOSIGNAL);
+            if (written < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    fail(index);
+                return;
+            }
+            conn.out_offset += static_cast<size_t>(written);
+        }
+    }
+
+    // The request on this connection is lost, count it and start over on a new socket
+    void fail(size_t index)
+    {
+        if (connections[index].busy)
+        {
+            result.status_classes[0]++;
+            complete_timing(connections[index].request);
+        }
+        result.reconnects++;
+        if (!connections[index].connected)
+        {
+            // Never got through, wait a little instead of hammering a server that is not up
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connections[index].fd, nullptr);
+            ::close(connections[index].fd);
+            connections[index] = connection();
+            connections[index].retry_at = load_clock::now() + std::chrono::milliseconds(100);
+            return;
+        }
+        open_connection(index);
+    }
+
+    void complete_timing(const in_flight &request)
+    {
+        auto now = load_clock::now();
+        result.corrected.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request.due).count()));
+        result.uncorrected.record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - request.sent).count()));
+    }
+
+    // Returns true once a whole response is buffered, handles Content-Length and chunked bodies
+    static bool response_complete(const std::string &in, size_t &body_start, size_t &body_length, bool &chunked)
+    {
+        size_t header_end = in.find("\r\n\r\n");
+        if (header_end == std::string::npos)
+            return false;
+        body_start = header_end + 4;
+
+        std::string headers = in.substr(0, header_end);
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+
+        size_t length_pos = headers.find("\r\ncontent-length:");
+        if (length_pos != std::string::npos)
+        {
+            chunked = false;
+            body_length = std::strtoul(headers.c_str() + length_pos + 17, nullptr, 10);
+            return in.size() >= body_start + body_length;
+        }
+
+        if (headers.find("transfer-encoding: chunked") != std::string::npos)
+        {
+            chunked = true;
+            size_t pos = body_start;
+            while (true)
+            {
+                size_t line_end = in.find("\r\n", pos);
+                if (line_end == std::string::npos)
+                    return false;
+                size_t size = std::strtoul(in.c_str() + pos, nullptr, 16);
+                pos = line_end + 2 + size + 2;
+                if (pos > in.size())
+                    return false;
+                if (size == 0)
+                {
+                    body_length = pos - body_start;
+                    return true;
+                }
+            }
+        }
+
+        // Neither, 1xx/204/304 have no body
+        chunked = false;
+        body_length = 0;
+        return true;
+    }
+
+    void on_readable(size_t index)
+    {
+        connection &conn = connections[index];
+        char buffer[16384];
+        while (true)
+        {
+            ssize_t received = ::recv(conn.fd, buffer, sizeof(buffer), 0);
+            if (received > 0)
+            {
+                conn.in.append(buffer, static_cast<size_t>(received));
+                continue;
+            }
+            if (received == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            {
+                fail(index);
+                return;
+            }
+            break;
+        }
+
+        size_t body_start, body_length;
+        bool chunked;
+        if (!conn.busy || !response_complete(conn.in, body_start, body_length, chunked))
+            return;
+
+        complete_timing(conn.request);
+        int status = std::atoi(conn.in.c_str() + 9);
+        if (status >= 100 && status < 600)
+            result.status_classes[status / 100]++;
+        else
+            result.status_classes[0]++;
+        if (conn.request.is_post && status == 201)
+            source.on_created(conn.in.substr(body_start, body_length));
+
+        std::string headers = conn.in.substr(0, body_start);
+        std::transform(headers.begin(), headers.end(), headers.begin(), ::tolower);
+        bool server_closes = headers.find("\r\nconnection: close") != std::string::npos;
+        conn.busy = false;
+        conn.in.clear();
+        if (server_closes)
+        {
+            result.reconnects++;
+            open_connection(index);
+        }
+    }
+
+    void dispatch_backlog()
+    {
+        for (size_t i = 0; i < connections.size() && !backlog.empty(); i++)
+        {
+            if (connections[i].busy || !connections[i].connected)
+                continue;
+            in_flight request = backlog.front();
+            std::string bytes = std::move(backlog_requests.front());
+            backlog.pop_front();
+            backlog_requests.pop_front();
+            send(i, request, std::move(bytes));
+        }
+    }
+
+    void run(load_clock::time_point start, load_clock::time_point end)
+    {
+        epoll_fd = epoll_create1(0);
+        connections.resize(static_cast<size_t>(connection_count));
+        for (size_t i = 0; i < connections.size(); i++)
+            open_connection(i);
+
+        auto interval = std::chrono::duration<double>(1.0 / rps);
+        uint64_t scheduled = 0;
+        std::vector<epoll_event> events(connections.size());
+
+        while (true)
+        {
+            auto now = load_clock::now();
+
+            // Every request that is due joins the backlog with its intended send time
+            while (true)
+            {
+                auto due = start + std::chrono::duration_cast<load_clock::duration>(interval * static_cast<double>(scheduled));
+                if (due > now || due >= end)
+                    break;
+                std::string bytes = source.next();
+                bool is_post = bytes.compare(0, 5, "POST ") == 0;
+                backlog.push_back({due, due, is_post});
+                backlog_requests.push_back(std::move(bytes));
+                scheduled++;
+            }
+            for (size_t i = 0; i < connections.size(); i++)
+            {
+                if (connections[i].fd < 0 && now >= connections[i].retry_at)
+                    open_connection(i);
+            }
+            dispatch_backlog();
+
+            bool any_busy = std::any_of(connections.begin(), connections.end(), [](const connection &c)
+                                        { return c.busy; });
+            if (now >= end && backlog.empty() && !any_busy)
+                break;
+            // Requests still outstanding a while after the end are counted as lost
+            if (now >= end + std::chrono::seconds(5))
+            {
+                for (size_t i = 0; i < connections.size(); i++)
+                {
+                    if (connections[i].busy)
+                        fail(i);
+                }
+                result.status_classes[0] += backlog.size();
+                for (const auto &request : backlog)
+                    complete_timing(request);
+                break;
+            }
+
+            auto next_due = start + std::chrono::duration_cast<load_clock::duration>(interval * static_cast<double>(scheduled));
+            int timeout_ms = 1;
+            if (next_due > now)
+                timeout_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(next_due - now).count());
+            timeout_ms = std::min(timeout_ms, 10);
+
+            int ready = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), timeout_ms);
+            for (int e = 0; e < ready; e++)
+            {
+                size_t index = events[e].data.u64;
+                connection &conn = connections[index];
+                if (events[e].events & (EPOLLERR | EPOLLHUP))
+                {
+                    fail(index);
+                    continue;
+                }
+                if ((events[e].events & EPOLLOUT) && !conn.connected)
+                {
+                    conn.connected = true;
+                    epoll_event event{};
+                    event.events = EPOLLIN | EPOLLOUT | EPOLLET | EPOLLRDHUP;
+                    event.data.u64 = index;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.fd, &event);
+                }
+                if (events[e].events & EPOLLOUT)
+                    flush(index);
+                if (events[e].events & (EPOLLIN | EPOLLRDHUP))
+                    on_readable(index);
+            }
+        }
+    }
+};
+
+// ---- Command line and report ----
+
+bool parse_mix(const std::string &list, loadgen_options &options)
+{
+    options.mix_get = options.mix_post = options.mix_put = options.mix_delete = 0;
+    size_t pos = 0;
+    while (pos < list.size())
+    {
+        size_t comma = list.find(',', pos);
+        std::string item = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? list.size() : comma + 1;
+
+        size_t colon = item.find(':');
+        if (colon == std::string::npos)
+            return false;
+        std::string method = item.substr(0, colon);
+        int weight = std::atoi(item.c_str() + colon + 1);
+        if (method == "get")
+            options.mix_get = weight;
+        else if (method == "post")
+            options.mix_post = weight;
+        else if (method == "put")
+            options.mix_put = weight;
+        else if (method == "delete")
+            options.mix_delete = weight;
+        else
+            return false;
+    }
+    return options.mix_get + options.mix_post + options.mix_put + options.mix_delete > 0;
+}
+
+bool parse_options(int argc, char *argv[], loadgen_options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string name = arg.substr(0, eq);
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+
+        if (name == "--host")
+            options.host = value;
+        else if (name == "--port")
+            options.port = std::stoi(value);
+        else if (name == "--rps")
+            options.rps = std::stod(value);
+        else if (name == "--duration")
+            options.duration = std::stod(value);
+        else if (name == "--connections")
+            options.connections = std::stoi(value);
+        else if (name == "--threads")
+            options.threads = std::stoi(value);
+        else if (name == "--replay")
+            options.replay = value;
+        else if (name == "--token")
+            options.token = value;
+        else if (name == "--mix")
+        {
+            if (!parse_mix(value, options))
+                return false;
+        }
+        else
+            return false;
+    }
+    return options.rps > 0 && options.duration > 0 && options.connections > 0 && options.threads > 0;
+}
+
+std::string format_ms(uint64_t nanos)
+{
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%.3f", static_cast<double>(nanos) / 1e6);
+    return buffer;
+}
+
+int main(int argc, char *argv[])
+{
+    loadgen_options options;
+    try
+    {
+        if (!parse_options(argc, argv, options))
+        {
+            std::cerr << "Usage: " << argv[0] << " [--host=127.0.0.1] [--port=8080] [--rps=1000] [--duration=10]"
+                      << " [--connections=64] [--threads=1] [--replay=FILE.jsonl] [--mix=get:80,post:10,put:5,delete:5]"
+                      << " [--token=admin-token-123]" << std::endl;
+            return 1;
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Invalid option: " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::vector<std::string> replay;
+    if (!options.replay.empty())
+    {
+        std::ifstream file(options.replay);
+        if (!file.is_open())
+        {
+            std::cerr << "Cannot open " << options.replay << std::endl;
+            return 1;
+        }
+        std::string line;
+        size_t line_number = 0;
+        while (std::getline(file, line))
+        {
+            line_number++;
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            request_template request;
+            if (!parse_replay_line(line, request))
+            {
+                std::cerr << options.replay << ":" << line_number << ": not a request, skipped" << std::endl;
+                continue;
+            }
+            replay.push_back(serialize_request(request, options.host));
+        }
+        if (replay.empty())
+        {
+            std::cerr << "No requests in " << options.replay << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::unique_ptr<worker>> workers;
+    for (int t = 0; t < options.threads; t++)
+    {
+        int connections = options.connections / options.threads + (t < options.connections % options.threads ? 1 : 0);
+        workers.push_back(std::make_unique<worker>(options, replay, 1234u + static_cast<unsigned>(t),
+                                                   options.rps / options.threads, std::max(1, connections)));
+    }
+
+    auto start = load_clock::now() + std::chrono::milliseconds(100); // let the connections open first
+    auto end = start + std::chrono::duration_cast<load_clock::duration>(std::chrono::duration<double>(options.duration));
+    std::vector<std::thread> threads;
+    for (auto &w : workers)
+        threads.emplace_back([&w, start, end]
+                             { w->run(start, end); });
+    for (auto &t : threads)
+        t.join();
+    double elapsed = std::chrono::duration<double>(load_clock::now() - start).count();
+
+    worker_result total;
+    for (auto &w : workers)
+    {
+        total.corrected.merge(w->result.corrected);
+        total.uncorrected.merge(w->result.uncorrected);
+        total.sent += w->result.sent;
+        total.reconnects += w->result.reconnects;
+        for (int c = 0; c < 6; c++)
+            total.status_classes[c] += w->result.status_classes[c];
+    }
+
+    std::cout << "target " << options.rps << " rps for " << options.duration << "s on " << options.connections
+              << " connections, " << total.corrected.count() << " requests in " << elapsed << "s ("
+              << static_cast<double>(total.corrected.count()) / elapsed << " rps)" << std::endl;
+    std::cout << "status 2xx=" << total.status_classes[2] << " 3xx=" << total.status_classes[3]
+              << " 4xx=" << total.status_classes[4] << " 5xx=" << total.status_classes[5]
+              << " errors=" << total.status_classes[0] << " reconnects=" << total.reconnects << std::endl;
+    std::cout << "latency (ms)          p50       p90       p99      p999       max" << std::endl;
+    for (auto [label, histogram] : {std::pair<const char *, const latency_histogram *>{"corrected  ", &total.corrected},
+                                    {"uncorrected", &total.uncorrected}})
+    {
+        char line[160];
+        std::snprintf(line, sizeof(line), "%s %9s %9s %9s %9s %9s", label,
+                      format_ms(histogram->percentile(0.5)).c_str(), format_ms(histogram->percentile(0.9)).c_str(),
+                      format_ms(histogram->percentile(0.99)).c_str(), format_ms(histogram->percentile(0.999)).c_str(),
+                      format_ms(histogram->max()).c_str());
+        std::cout << line << std::endl;
+    }
+    return 0;
+}
@@ -1,6 +1,11 @@
 #pragma once
 
+#include "../definentions.hpp"
 #include "../utils/utils.hpp"
+#include "../utils/response_cache.hpp"
+#include "../utils/metrics.hpp"
+#include "../utils/json_writer.hpp"
+#include "../utils/json_reader.hpp"
 #include "../models/models.hpp"
 #include "../library/web-lib.hpp"
 #include "../library/libs/json/json-parser.hpp"
@@ -9,6 +14,19 @@
 
 using namespace hh_json;
 
+// Page sizes of GET /api/blogs?limit=
+const size_t API_DEFAULT_PAGE_SIZE = 50;
+const size_t API_MAX_PAGE_SIZE = 1000;
+
+// Result counts of GET /api/search?limit=
+const size_t API_DEFAULT_SEARCH_LIMIT = 10;
+const size_t API_MAX_SEARCH_LIMIT = 100;
+
+// Most operations accepted by one POST /api/blogs/batch. The body size cap is what bounds a batch
+// in practice (64 KB holds ~100 creates of 600 byte posts). This one only has to match what fits:
+// the shortest operation, {"op":"delete","id":1}, is 22 bytes.
+const size_t API_MAX_BATCH_OPERATIONS = MAX_REQUEST_BODY_SIZE / 22;
+
 // Middleware for API admin authentication
 hh_web::exit_code api_auth_admin(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
 {
@@ -49,24 +67,50 @@ hh_web::exit_code api_auth_admin(std::shared_ptr<hh_web::web_request> req, std::
 }
 
 // GET /api/blogs - Get all blogs
+// GET /api/blogs?limit=&after=&fields= - Get one page of blogs, optionally projected to some fields
 hh_web::exit_code api_get_all_blogs_controller(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
 {
     try
     {
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
+        // Only the full listing (no query) is cached
+        auto query = parse_query_params(req);
+        if (query.empty() && send_cached_response(req, res, response_keys::API_BLOGS))
+            return hh_web::exit_code::EXIT;
 
-        auto response_json = std::make_shared<JsonObject>();
-        auto blogs_array = std::make_shared<JsonArray>();
+        bool paged = query.count("limit") || query.count("after");
+        int after;
+        size_t limit;
+        if (!parse_page_query(query, paged ? API_DEFAULT_PAGE_SIZE : SIZE_MAX, API_MAX_PAGE_SIZE, after, limit))
+        {
+            send_json_error(res, "Invalid limit or after", 400);
+            return hh_web::exit_code::EXIT;
+        }
 
-        for (const auto &blog : blogs)
+        unsigned fields = BLOG_FIELDS_ALL;
+        if (query.count("fields") && !parse_blog_fields(query["fields"], fields))
         {
-            blogs_array->insert(blog_to_json(blog));
+            send_json_error(res, "Invalid fields", 400);
+            return hh_web::exit_code::EXIT;
         }
 
-        response_json->insert("blogs", blogs_array);
-        response_json->insert("count", maker::make_number(blogs.size()));
+        // One snapshot for the validators and the body, so they always agree
+        auto generation = response_cache().generation();
+        auto snapshot = blog_repository().snapshot();
+        if (send_not_modified_if_current(req, res, collection_validators("json", snapshot->collection)))
+            return hh_web::exit_code::EXIT;
+
+        if (query.empty())
+        {
+            send_and_cache_response(res, response_keys::API_BLOGS, generation, "application/json", blogs_to_json_string(snapshot->get_all()),
+                                    collection_validators("json", snapshot->collection));
+            return hh_web::exit_code::EXIT;
+        }
 
-        send_json_response(res, response_json);
+        auto page = snapshot->get_page(after, limit);
+        set_validator_headers(res, collection_validators("json", page.version));
+        res->set_status(200, "OK");
+        res->set_header("Content-Type", "application/json");
+        set_response_body(res, blogs_to_json_string(page.blogs, fields, paged, page.next_after));
         return hh_web::exit_code::EXIT;
     }
     catch (const std::exception &e)
@@ -99,10 +143,17 @@ hh_web::exit_code api_get_single_blog_controller(std::shared_ptr<hh_web::web_req
             return hh_web::exit_code::EXIT;
         }
 
-        Blog blog = get_blog_by_id(blog_id);
-        auto blog_json = blog_to_json(blog);
+        // The JSON serialized with the entry is the cache, no ResponseCache copy on top of it
+        auto snapshot = blog_repository().snapshot();
+        auto entry = snapshot->find_entry(blog_id);
+        if (!entry)
+        {
+            throw std::runtime_error("Blog not found");
+        }
+        if (send_not_modified_if_current(req, res, blog_validators("json", blog_id, entry->version)))
+            return hh_web::exit_code::EXIT;
 
-        send_json_response(res, blog_json);
+        send_response(res, "application/json", *cached_blog_json(*entry), blog_validators("json", blog_id, entry->version));
         return hh_web::exit_code::EXIT;
     }
     catch (const std::exception &e)
@@ -112,46 +163,102 @@ hh_web::exit_code api_get_single_blog_controller(std::shared_ptr<hh_web::web_req
     }
 }
 
-// POST /api/blogs - Create new blog
-hh_web::exit_code api_create_blog_controller(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+// GET /api/search?q=&limit= - Blogs ranked by relevance to q, with their preview as the snippet
+hh_web::exit_code api_search_controller(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
 {
     try
     {
-        // Parse JSON body
-        auto parsed_json = parse(req->get_body());
+        auto query = parse_query_params(req);
+        auto q = query.find("q");
+        if (q == query.end() || q->second.empty())
+        {
+            send_json_error(res, "Missing q", 400);
+            return hh_web::exit_code::EXIT;
+        }
 
-        // Extract required fields
-        std::string title, content;
+        // Results are ranked, not ordered by id, so there is no cursor to continue from
+        if (query.count("after"))
+        {
+            send_json_error(res, "after is not supported, use limit", 400);
+            return hh_web::exit_code::EXIT;
+        }
 
-        if (parsed_json.find("title") != parsed_json.end())
+        int after;
+        size_t limit;
+        if (!parse_page_query(query, API_DEFAULT_SEARCH_LIMIT, API_MAX_SEARCH_LIMIT, after, limit))
         {
-            title = getter::get_string(parsed_json["title"]);
+            send_json_error(res, "Invalid limit", 400);
+            return hh_web::exit_code::EXIT;
         }
 
-        if (parsed_json.find("content") != parsed_json.end())
+        auto hits = blog_repository().get_search_index().search(q->second, limit);
+        auto snapshot = blog_repository().snapshot();
+
+        const unsigned fields = BLOG_FIELD_ID | BLOG_FIELD_TITLE | BLOG_FIELD_PREVIEW_CONTENT | BLOG_FIELD_CREATED_AT;
+        std::string out = "{\"query\":";
+        append_json_string(out, q->second);
+        out += ",\"results\":[";
+        size_t count = 0;
+        char score[32];
+        for (const auto &hit : hits)
         {
-            content = getter::get_string(parsed_json["content"]);
+            // The index can be ahead of this snapshot by a write
+            auto entry = snapshot->find_entry(hit.id);
+            if (!entry)
+                continue;
+            if (count++ > 0)
+                out += ',';
+            append_blog_json(out, *entry->blog, fields);
+            out.pop_back();
+            std::snprintf(score, sizeof(score), ",\"score\":%.4f}", hit.score);
+            out += score;
         }
+        out += "],\"count\":";
+        out += std::to_string(count);
+        out += '}';
 
-        if (title.empty() || content.empty())
+        res->set_status(200, "OK");
+        res->set_header("Content-Type", "application/json");
+        set_response_body(res, out);
+        return hh_web::exit_code::EXIT;
+    }
+    catch (const std::exception &e)
+    {
+        send_json_error(res, "Error searching blogs");
+        return hh_web::exit_code::EXIT;
+    }
+}
+
+// POST /api/blogs - Create new blog
+hh_web::exit_code api_create_blog_controller(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    try
+    {
+        // Index the JSON body, only the fields read below get decoded
+        const std::string &body = req->get_body();
+        JsonObjectIndex fields(body);
+        if (!fields.is_valid())
+        {
+            send_json_error(res, "Invalid JSON body", 400);
+            return hh_web::exit_code::EXIT;
+        }
+
+        // Extract required fields, anything that is not a string counts as missing
+        std::string title, content;
+        if (!fields.get_string("title", title) || !fields.get_string("content", content) ||
+            title.empty() || content.empty())
         {
             send_json_error(res, "Title and content are required", 400);
             return hh_web::exit_code::EXIT;
         }
 
-        // Create preview content (first 150 characters)
-        std::string preview = content.length() > 150 ? content.substr(0, 150) + "..." : content;
+        std::string preview = make_preview(content);
         std::string created_at = get_current_timestamp();
 
-        // Load existing blogs
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
-
-        // Create new blog
-        Blog new_blog(title, content, preview, created_at);
-        blogs.push_back(new_blog);
-
-        // Save blogs
-        save_blogs_to_file(blogs);
+        // Create and persist the new blog
+        Blog new_blog = blog_repository().create(title, content, preview, created_at);
+        invalidate_blog_responses();
+        prerender_blog(new_blog.get_id());
 
         // Return created blog
         auto response_json = std::make_shared<JsonObject>();
@@ -191,63 +298,41 @@ hh_web::exit_code api_update_blog_controller(std::shared_ptr<hh_web::web_request
             return hh_web::exit_code::EXIT;
         }
 
-        // Parse JSON body
-        auto parsed_json = parse(req->get_body());
-
-        // Extract fields to update
-        std::string title, content;
-
-        if (parsed_json.find("title") != parsed_json.end())
-        {
-            title = getter::get_string(parsed_json["title"]);
-        }
-
-        if (parsed_json.find("content") != parsed_json.end())
+        // Index the JSON body, only the fields read below get decoded
+        const std::string &body = req->get_body();
+        JsonObjectIndex fields(body);
+        if (!fields.is_valid())
         {
-            content = getter::get_string(parsed_json["content"]);
+            send_json_error(res, "Invalid JSON body", 400);
+            return hh_web::exit_code::EXIT;
         }
 
-        if (title.empty() || content.empty())
+        // Extract fields to update, anything that is not a string counts as missing
+        std::string title, content;
+        if (!fields.get_string("title", title) || !fields.get_string("content", content) ||
+            title.empty() || content.empty())
         {
             send_json_error(res, "Title and content are required", 400);
             return hh_web::exit_code::EXIT;
         }
 
-        // Load existing blogs
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
+        // Update preview
+        std::string preview = make_preview(content);
 
-        // Find and update the blog
-        bool found = false;
-        Blog updated_blog(title, content, "", ""); // Temporary blog for response
-
-        for (auto &blog : blogs)
-        {
-            if (blog.get_id() == blog_id)
-            {
-                blog.set_title(title);
-                blog.set_content(content);
-                // Update preview
-                std::string preview = content.length() > 150 ? content.substr(0, 150) + "..." : content;
-                blog.set_preview_content(preview);
-                updated_blog = blog; // Copy for response
-                found = true;
-                break;
-            }
-        }
-
-        if (!found)
+        // Find, update and persist the blog
+        auto updated_blog = blog_repository().update(blog_id, title, content, preview);
+        if (!updated_blog)
         {
             send_json_error(res, "Blog not found", 404);
             return hh_web::exit_code::EXIT;
         }
-
-        // Save blogs
-        save_blogs_to_file(blogs);
+        invalidate_blog_responses();
+        prerender_blog(blog_id);
 
         // Return updated blog
         auto response_json = std::make_shared<JsonObject>();
         response_json->insert("message", maker::make_string("Blog updated successfully"));
-        response_json->insert("blog", blog_to_json(updated_blog));
+        response_json->insert("blog", blog_to_json(*updated_blog));
 
         send_json_response(res, response_json);
         return hh_web::exit_code::EXIT;
@@ -282,24 +367,13 @@ hh_web::exit_code api_delete_blog_controller(std::shared_ptr<hh_web::web_request
             return hh_web::exit_code::EXIT;
         }
 
-        // Load existing blogs
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
-
-        // Find and remove the blog
-        auto it = std::remove_if(blogs.begin(), blogs.end(),
-                                 [blog_id](const Blog &blog)
-                                 { return blog.get_id() == blog_id; });
-
-        if (it == blogs.end())
+        // Find, remove and persist
+        if (!blog_repository().remove(blog_id))
         {
             send_json_error(res, "Blog not found", 404);
             return hh_web::exit_code::EXIT;
         }
-
-        blogs.erase(it, blogs.end());
-
-        // Save blogs
-        save_blogs_to_file(blogs);
+        invalidate_blog_responses();
 
         // Return success response
         auto response_json = std::make_shared<JsonObject>();
@@ -314,3 +388,241 @@ hh_web::exit_code api_delete_blog_controller(std::shared_ptr<hh_web::web_request
         return hh_web::exit_code::EXIT;
     }
 }
+
+// One operation of a batch as read from the body, error is set when it is invalid
+struct BatchOperation
+{
+    std::string op;
+    BlogWrite write;
+    std::string error;
+};
+
+// Reads {"op":"create"|"update"|"delete","id":N,"title":"..","content":".."}, false when the JSON itself is malformed
+bool read_batch_operation(JsonCursor &cursor, BatchOperation &operation)
+{
+    if (!cursor.consume('{'))
+        return false;
+
+    bool has_id = false;
+    int id = -1;
+    std::string title, content;
+    if (!cursor.consume('}'))
+    {
+        while (true)
+        {
+            std::string key;
+            if (!cursor.read_string(key) || !cursor.consume(':'))
+                return false;
+
+            bool ok;
+            if (key == "op")
+                ok = cursor.read_string(operation.op);
+            else if (key == "id")
+                ok = has_id = cursor.read_int(id);
+            else if (key == "title")
+                ok = cursor.read_string(title);
+            else if (key == "content")
+                ok = cursor.read_string(content);
+            else
+                ok = cursor.skip_value();
+            if (!ok)
+                return false;
+
+            if (cursor.consume('}'))
+                break;
+            if (!cursor.consume(','))
+                return false;
+        }
+    }
+
+    // Same rules as the single-blog endpoints
+    BlogWrite &write = operation.write;
+    if (operation.op == "create")
+        write.type = BlogWrite::kind::create;
+    else if (operation.op == "update")
+        write.type = BlogWrite::kind::update;
+    else if (operation.op == "delete")
+        write.type = BlogWrite::kind::remove;
+    else
+    {
+        operation.error = "Unknown op, expected create, update or delete";
+        return true;
+    }
+
+    if (write.type != BlogWrite::kind::create)
+    {
+        if (!has_id || id < 0)
+        {
+            operation.error = "Invalid blog ID";
+            return true;
+        }
+        write.id = id;
+    }
+    if (write.type != BlogWrite::kind::remove)
+    {
+        if (title.empty() || content.empty())
+        {
+            operation.error = "Title and content are required";
+            return true;
+        }
+        write.preview_content = make_preview(content);
+        write.title = std::move(title);
+        write.content = std::move(content);
+    }
+    return true;
+}
+
+// Body is [op, ...] or {"operations":[op, ...]}
+bool read_batch_operations(const std::string &body, std::vector<BatchOperation> &operations)
+{
+    JsonCursor cursor(body);
+    bool wrapped = cursor.peek() == '{';
+    if (wrapped)
+    {
+        cursor.consume('{');
+        std::string key;
+        if (!cursor.read_string(key) || key != "operations" || !cursor.consume(':'))
+            return false;
+    }
+
+    if (!cursor.consume('['))
+        return false;
+    if (!cursor.consume(']'))
+    {
+        while (true)
+        {
+            if (operations.size() >= API_MAX_BATCH_OPERATIONS)
+                return false;
+            operations.emplace_back();
+            if (!read_batch_operation(cursor, operations.back()))
+                return false;
+            if (cursor.consume(']'))
+                break;
+            if (!cursor.consume(','))
+                return false;
+        }
+    }
+
+    if (wrapped && !cursor.consume('}'))
+        return false;
+    return cursor.at_end();
+}
+
+// {"index":i,"op":"..","status":N} plus "blog" or "error"
+void append_batch_result(std::string &out, size_t index, const BatchOperation &operation, int status,
+                         const std::optional<Blog> &blog, const std::string &error)
+{
+    out += "{\"index\":";
+    out += std::to_string(index);
+    out += ",\"op\":";
+    append_json_string(out, operation.op);
+    out += ",\"status\":";
+    out += std::to_string(status);
+    if (blog)
+    {
+        out += ",\"blog\":";
+        append_blog_json(out, *blog);
+    }
+    if (!error.empty())
+    {
+        out += ",\"error\":";
+        append_json_string(out, error);
+    }
+    out += '}';
+}
+
+// POST /api/blogs/batch - Apply many create/update/delete operations atomically, in one storage write.
+// Nothing is applied unless every operation is valid and every blog it updates or deletes exists.
+hh_web::exit_code api_batch_blogs_controller(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    try
+    {
+        std::vector<BatchOperation> operations;
+        if (!read_batch_operations(req->get_body(), operations))
+        {
+            send_json_error(res, "Expected a JSON array of at most " + std::to_string(API_MAX_BATCH_OPERATIONS) + " operations", 400);
+            return hh_web::exit_code::EXIT;
+        }
+        if (operations.empty())
+        {
+            send_json_error(res, "No operations", 400);
+            return hh_web::exit_code::EXIT;
+        }
+
+        std::string body = "{\"results\":[";
+        bool valid = true;
+        for (const auto &operation : operations)
+            valid = valid && operation.error.empty();
+
+        if (!valid)
+        {
+            for (size_t i = 0; i < operations.size(); i++)
+            {
+                if (i > 0)
+                    body += ',';
+                bool invalid = !operations[i].error.empty();
+                append_batch_result(body, i, operations[i], invalid ? 400 : 409, std::nullopt,
+                                    invalid ? operations[i].error : "Not applied");
+            }
+            body += "],\"error\":\"Invalid operations, nothing was applied\"}";
+            res->set_status(400, "Bad Request");
+            res->set_header("Content-Type", "application/json");
+            set_response_body(res, body);
+            return hh_web::exit_code::EXIT;
+        }
+
+        std::string created_at = get_current_timestamp();
+        std::vector<BlogWrite> writes;
+        writes.reserve(operations.size());
+        for (auto &operation : operations)
+        {
+            if (operation.write.type == BlogWrite::kind::create)
+                operation.write.created_at = created_at;
+            writes.push_back(operation.write);
+        }
+
+        auto results = blog_repository().submit(std::move(writes), true).get();
+
+        bool applied = true;
+        for (const auto &result : results)
+            applied = applied && result.found;
+
+        for (size_t i = 0; i < operations.size(); i++)
+        {
+            if (i > 0)
+                body += ',';
+            const auto &result = results[i];
+            if (!applied)
+            {
+                append_batch_result(body, i, operations[i], result.found ? 409 : 404, std::nullopt,
+                                    result.found ? "Not applied" : "Blog not found");
+                continue;
+            }
+
+            if (operations[i].write.type != BlogWrite::kind::remove)
+                prerender_blog(result.blog->get_id());
+            append_batch_result(body, i, operations[i], operations[i].write.type == BlogWrite::kind::create ? 201 : 200,
+                                result.blog, "");
+        }
+
+        if (applied)
+        {
+            invalidate_blog_responses();
+            body += "],\"count\":" + std::to_string(operations.size()) + "}";
+            res->set_status(200, "OK");
+        }
+        else
+        {
+            body += "],\"error\":\"Some blogs were not found, nothing was applied\"}";
+            res->set_status(409, "Conflict");
+        }
+        res->set_header("Content-Type", "application/json");
+        set_response_body(res, body);
+        return hh_web::exit_code::EXIT;
+    }
+    catch (const std::exception &e)
+    {
+        send_json_error(res, "Error applying batch");
+        return hh_web::exit_code::EXIT;
+    }
+}
@@ -1,25 +1,60 @@
 #pragma once
 
 #include "../utils/utils.hpp"
+#include "../utils/response_cache.hpp"
+#include "../utils/metrics.hpp"
 #include "../models/models.hpp"
 #include "../views/views.hpp"
 #include "../library/web-lib.hpp"
 
-// GET /
+// Articles per page on the home page
+const size_t INDEX_PAGE_SIZE = 20;
+
+// GET /?after=<id>
 hh_web::exit_code index_controller(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
 {
     try
     {
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
-        std::string html = index_view(blogs);
-        res->set_header("Content-Type", "text/html");
-        res->set_body(html);
+        // Only the first page (no query) is cached
+        auto query = parse_query_params(req);
+        if (query.empty() && send_cached_response(req, res, response_keys::INDEX))
+            return hh_web::exit_code::EXIT;
+
+        int after;
+        size_t limit;
+        if (!parse_page_query(query, INDEX_PAGE_SIZE, INDEX_PAGE_SIZE, after, limit))
+        {
+            res->set_status(400, "Bad Request");
+            set_response_body(res, "Invalid page");
+            return hh_web::exit_code::EXIT;
+        }
+
+        // One snapshot for the validators and the page, so they always agree
+        auto generation = response_cache().generation();
+        auto snapshot = blog_repository().snapshot();
+        if (send_not_modified_if_current(req, res, collection_validators("html", snapshot->collection)))
+            return hh_web::exit_code::EXIT;
+
+        auto page = snapshot->get_entry_page(after, limit);
+        auto validators = collection_validators("html", page.version);
+        std::string html = index_view(page);
+
+        if (query.empty())
+        {
+            send_and_cache_response(res, response_keys::INDEX, generation, "text/html", std::move(html), validators);
+        }
+        else
+        {
+            set_validator_headers(res, validators);
+            res->set_header("Content-Type", "text/html");
+            set_response_body(res, html);
+        }
         return hh_web::exit_code::EXIT;
     }
     catch (const std::exception &e)
     {
         res->set_status(500, "Internal Server Error");
-        res->set_body("Error loading blogs");
+        set_response_body(res, "Error loading blogs");
         return hh_web::exit_code::EXIT;
     }
 }
@@ -44,20 +79,27 @@ hh_web::exit_code get_single_blog_controller(std::shared_ptr<hh_web::web_request
         if (blog_id == -1)
         {
             res->set_status(400, "Bad Request");
-            res->set_body("Invalid blog ID");
+            set_response_body(res, "Invalid blog ID");
             return hh_web::exit_code::EXIT;
         }
 
-        Blog blog = get_blog_by_id(blog_id);
-        std::string html = get_single_blog_view(blog);
-        res->set_header("Content-Type", "text/html");
-        res->set_body(html);
+        // The page rendered with the entry is the cache, no ResponseCache copy on top of it
+        auto snapshot = blog_repository().snapshot();
+        auto entry = snapshot->find_entry(blog_id);
+        if (!entry)
+        {
+            throw std::runtime_error("Blog not found");
+        }
+        if (send_not_modified_if_current(req, res, blog_validators("html", blog_id, entry->version)))
+            return hh_web::exit_code::EXIT;
+
+        send_response(res, "text/html", *cached_blog_page(*entry), blog_validators("html", blog_id, entry->version));
         return hh_web::exit_code::EXIT;
     }
     catch (const std::exception &e)
     {
         res->set_status(404, "Not Found");
-        res->set_body("Blog not found");
+        set_response_body(res, "Blog not found");
         return hh_web::exit_code::EXIT;
     }
 }
@@ -67,7 +109,7 @@ hh_web::exit_code admin_login_controller(std::shared_ptr<hh_web::web_request> re
 {
     std::string html = admin_login_view();
     res->set_header("Content-Type", "text/html");
-    res->set_body(html);
+    set_response_body(res, html);
     return hh_web::exit_code::EXIT;
 }
 
@@ -78,8 +120,8 @@ hh_web::exit_code admin_login_post_controller(std::shared_ptr<hh_web::web_reques
     {
         auto form_data = parse_form_data(req->get_body());
 
-        std::string username = form_data["username"];
-        std::string password = form_data["password"];
+        std::string username(form_data.get("username"));
+        std::string password(form_data.get("password"));
 
         // Simple authentication (in production, use proper password hashing)
         if (username == "admin" && password == "password")
@@ -100,7 +142,7 @@ hh_web::exit_code admin_login_post_controller(std::shared_ptr<hh_web::web_reques
     catch (const std::exception &e)
     {
         res->set_status(500, "Internal Server Error");
-        res->set_body("Login error");
+        set_response_body(res, "Login error");
         return hh_web::exit_code::EXIT;
     }
 }
@@ -110,16 +152,18 @@ hh_web::exit_code admin_dashboard_controller(std::shared_ptr<hh_web::web_request
 {
     try
     {
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
-        std::string html = admin_dashboard_view(blogs);
-        res->set_header("Content-Type", "text/html");
-        res->set_body(html);
+        if (send_cached_response(req, res, response_keys::ADMIN_DASHBOARD))
+            return hh_web::exit_code::EXIT;
+
+        auto generation = response_cache().generation();
+        auto blogs = blog_repository().get_all();
+        send_and_cache_response(res, response_keys::ADMIN_DASHBOARD, generation, "text/html", admin_dashboard_view(blogs));
         return hh_web::exit_code::EXIT;
     }
     catch (const std::exception &e)
     {
         res->set_status(500, "Internal Server Error");
-        res->set_body("Error loading dashboard");
+        set_response_body(res, "Error loading dashboard");
         return hh_web::exit_code::EXIT;
     }
 }
@@ -144,20 +188,20 @@ hh_web::exit_code admin_edit_blog_controller(std::shared_ptr<hh_web::web_request
         if (blog_id == -1)
         {
             res->set_status(400, "Bad Request");
-            res->set_body("Invalid blog ID");
+            set_response_body(res, "Invalid blog ID");
             return hh_web::exit_code::EXIT;
         }
 
         Blog blog = get_blog_by_id(blog_id);
         std::string html = admin_edit_blog_view(blog);
         res->set_header("Content-Type", "text/html");
-        res->set_body(html);
+        set_response_body(res, html);
         return hh_web::exit_code::EXIT;
     }
     catch (const std::exception &e)
     {
         res->set_status(404, "Not Found");
-        res->set_body("Blog not found");
+        set_response_body(res, "Blog not found");
         return hh_web::exit_code::EXIT;
     }
 }
@@ -169,30 +213,24 @@ hh_web::exit_code create_blog_controller(std::shared_ptr<hh_web::web_request> re
     {
         auto form_data = parse_form_data(req->get_body());
 
-        std::string title = form_data["title"];
-        std::string content = form_data["content"];
+        std::string title(form_data.get("title"));
+        std::string content(form_data.get("content"));
 
         if (title.empty() || content.empty())
         {
             res->set_status(400, "Bad Request");
-            res->set_body("Title and content are required");
+            set_response_body(res, "Title and content are required");
             return hh_web::exit_code::EXIT;
         }
 
-        // Create preview content (first 150 characters)
-        std::string preview = content.length() > 150 ? content.substr(0, 150) + "..." : content;
+        std::string preview = make_preview(content);
 
         std::string created_at = get_current_timestamp();
 
-        // Load existing blogs
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
-
-        // Create new blog
-        Blog new_blog(title, content, preview, created_at);
-        blogs.push_back(new_blog);
-
-        // Save blogs
-        save_blogs_to_file(blogs);
+        // Create and persist the new blog
+        Blog new_blog = blog_repository().create(title, content, preview, created_at);
+        invalidate_blog_responses();
+        prerender_blog(new_blog.get_id());
 
         res->set_status(302, "Found");
         res->add_header("Location", "/admin/dashboard");
@@ -201,7 +239,7 @@ hh_web::exit_code create_blog_controller(std::shared_ptr<hh_web::web_request> re
     catch (const std::exception &e)
     {
         res->set_status(500, "Internal Server Error");
-        res->set_body("Error creating blog");
+        set_response_body(res, "Error creating blog");
         return hh_web::exit_code::EXIT;
     }
 }
@@ -226,49 +264,33 @@ hh_web::exit_code update_blog_controller(std::shared_ptr<hh_web::web_request> re
         if (blog_id == -1)
         {
             res->set_status(400, "Bad Request");
-            res->set_body("Invalid blog ID");
+            set_response_body(res, "Invalid blog ID");
             return hh_web::exit_code::EXIT;
         }
 
         auto form_data = parse_form_data(req->get_body());
-        std::string title = form_data["title"];
-        std::string content = form_data["content"];
+        std::string title(form_data.get("title"));
+        std::string content(form_data.get("content"));
 
         if (title.empty() || content.empty())
         {
             res->set_status(400, "Bad Request");
-            res->set_body("Title and content are required");
+            set_response_body(res, "Title and content are required");
             return hh_web::exit_code::EXIT;
         }
 
-        // Load existing blogs
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
+        // Update preview
+        std::string preview = make_preview(content);
 
-        // Find and update the blog
-        bool found = false;
-        for (auto &blog : blogs)
-        {
-            if (blog.get_id() == blog_id)
-            {
-                blog.set_title(title);
-                blog.set_content(content);
-                // Update preview
-                std::string preview = content.length() > 150 ? content.substr(0, 150) + "..." : content;
-                blog.set_preview_content(preview);
-                found = true;
-                break;
-            }
-        }
-
-        if (!found)
+        // Find, update and persist the blog
+        if (!blog_repository().update(blog_id, title, content, preview))
         {
             res->set_status(404, "Not Found");
-            res->set_body("Blog not found");
+            set_response_body(res, "Blog not found");
             return hh_web::exit_code::EXIT;
         }
-
-        // Save blogs
-        save_blogs_to_file(blogs);
+        invalidate_blog_responses();
+        prerender_blog(blog_id);
 
         res->set_status(302, "Found");
         res->add_header("Location", "/admin/dashboard");
@@ -277,7 +299,7 @@ hh_web::exit_code update_blog_controller(std::shared_ptr<hh_web::web_request> re
     catch (const std::exception &e)
     {
         res->set_status(500, "Internal Server Error");
-        res->set_body("Error updating blog");
+        set_response_body(res, "Error updating blog");
         return hh_web::exit_code::EXIT;
     }
 }
@@ -302,29 +324,18 @@ hh_web::exit_code delete_blog_controller(std::shared_ptr<hh_web::web_request> re
         if (blog_id == -1)
         {
             res->set_status(400, "Bad Request");
-            res->set_body("Invalid blog ID");
+            set_response_body(res, "Invalid blog ID");
             return hh_web::exit_code::EXIT;
         }
 
-        // Load existing blogs
-        auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
-
-        // Find and remove the blog
-        auto it = std::remove_if(blogs.begin(), blogs.end(),
-                                 [blog_id](const Blog &blog)
-                                 { return blog.get_id() == blog_id; });
-
-        if (it == blogs.end())
+        // Find, remove and persist
+        if (!blog_repository().remove(blog_id))
         {
             res->set_status(404, "Not Found");
-            res->set_body("Blog not found");
+            set_response_body(res, "Blog not found");
             return hh_web::exit_code::EXIT;
         }
-
-        blogs.erase(it, blogs.end());
-
-        // Save blogs
-        save_blogs_to_file(blogs);
+        invalidate_blog_responses();
 
         res->set_status(204, "No Content");
         return hh_web::exit_code::EXIT;
@@ -332,7 +343,7 @@ hh_web::exit_code delete_blog_controller(std::shared_ptr<hh_web::web_request> re
     catch (const std::exception &e)
     {
         res->set_status(500, "Internal Server Error");
-        res->set_body("Error deleting blog");
+        set_response_body(res, "Error deleting blog");
         return hh_web::exit_code::EXIT;
     }
 }
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "../utils/metrics.hpp"
+#include "../utils/tracing.hpp"
+#include "../library/web-lib.hpp"
+
+// GET /metrics - Prometheus text exposition of the per-route metrics
+hh_web::exit_code metrics_controller(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    res->set_status(200, "OK");
+    res->set_header("Content-Type", "text/plain; version=0.0.4");
+    set_response_body(res, metrics::get_registry().scrape());
+    return hh_web::exit_code::EXIT;
+}
+
+// GET /debug/trace - the sampled spans still in the ring buffer as Chrome trace-event JSON,
+// open it in chrome://tracing or ui.perfetto.dev
+hh_web::exit_code trace_dump_controller(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    res->set_status(200, "OK");
+    res->set_header("Content-Type", "application/json");
+    res->set_header("Cache-Control", "no-store");
+    set_response_body(res, tracing::get_tracer().dump_chrome_json());
+    return hh_web::exit_code::EXIT;
+}
@@ -3,5 +3,12 @@
 #define CPP_PROJECT_SOURCE_DIR "/home/hamza/Documents/Learnings/Projects/simple-blog-from-scratch"
 #endif
 
+// Largest request body the server accepts (hh_http::config::MAX_BODY_SIZE)
+#define MAX_REQUEST_BODY_SIZE (1024 * 64)
+
 #define Route_V(...) \
-    std::vector<hh_web::web_request_handler_t<>> { __VA_ARGS__ }
\ No newline at end of file
+    std::vector<hh_web::web_request_handler_t<>> { __VA_ARGS__ }
+
+// Route_V with a trace span around every handler, named after it (see trace_stages)
+#define Traced_V(...) \
+    trace_stages(#__VA_ARGS__, Route_V(__VA_ARGS__))
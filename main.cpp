@@ -1,15 +1,65 @@
 
 #include "definentions.hpp"
+#include <iomanip>
 #include <iostream>
 #include "library/web-lib.hpp"
 #include "views/views.hpp"
 #include "routes/routes.hpp"
+#include "models/blog_repository.hpp"
 
-int main()
+int main(int argc, char *argv[])
 {
-    
+    // --storage=text|binary selects the snapshot format,
+    // --convert-db writes blogs.db (and its log) out as blogs.bin and exits, it refuses to replace an
+    // existing blogs.bin (which may hold writes made with --storage=binary) unless --force is given,
+    // --dev recompiles templates from views/html when their mtime changes,
+    // --trace-sample=RATE traces that fraction of requests (0..1, default 0), dumped at /debug/trace
+    snapshot_format storage = snapshot_format::text;
+    bool convert_db = false;
+    bool force = false;
+    bool dev_mode = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--storage=binary")
+            storage = snapshot_format::binary;
+        else if (arg == "--storage=text")
+            storage = snapshot_format::text;
+        else if (arg == "--convert-db")
+            convert_db = true;
+        else if (arg == "--force")
+            force = true;
+        else if (arg == "--dev")
+            dev_mode = true;
+        else if (arg.rfind("--trace-sample=", 0) == 0)
+            tracing::get_tracer().set_sample_rate(std::atof(arg.c_str() + 15));
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--storage=text|binary] [--convert-db [--force]] [--dev] [--trace-sample=RATE]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::string text_db_path = CPP_PROJECT_SOURCE_DIR + std::string("blogs.db");
+    std::string binary_db_path = CPP_PROJECT_SOURCE_DIR + std::string("blogs.bin");
+
+    if (convert_db && !force && std::ifstream(binary_db_path))
+    {
+        std::cerr << binary_db_path << " already exists and may hold newer writes than blogs.db, "
+                  << "pass --force to replace it (and drop its log)" << std::endl;
+        return 1;
+    }
+
     try
     {
+        if (convert_db || (storage == snapshot_format::binary && !std::ifstream(binary_db_path)))
+        {
+            auto count = BlogLog::convert(text_db_path, snapshot_format::text, binary_db_path, snapshot_format::binary);
+            std::cout << "Converted " << count << " blogs to " << binary_db_path << std::endl;
+            if (convert_db)
+                return 0;
+        }
+
 		hh_socket::initialize_socket_library();
 
 
@@ -17,10 +67,26 @@ int main()
         std::string host = "0.0.0.0";
         //hh_web::logger::absolute_path_to_logs = "/home/hamza/Documents/Learnings/Projects/simple-blog-from-scratch/logs/";
         //hh_web::logger::enabled_logging = true;
-        hh_http::config::MAX_BODY_SIZE = 1024 * 64;
+        hh_http::config::MAX_BODY_SIZE = MAX_REQUEST_BODY_SIZE;
         hh_http::config::MAX_HEADER_SIZE = 1024 * 4;
         hh_http::config::MAX_IDLE_TIME_SECONDS = std::chrono::seconds(5);
 
+        // Compile the templates once, views only render from the cache
+        template_cache().load_directory(CPP_PROJECT_SOURCE_DIR + std::string("views/html"), dev_mode);
+        response_cache().set_enabled(!dev_mode);
+
+        // Load the blogs once, every request is served from memory afterwards
+        if (storage == snapshot_format::binary)
+            blog_repository().load(binary_db_path, snapshot_format::binary);
+        else
+            blog_repository().load(text_db_path, snapshot_format::text);
+        auto load = blog_repository().get_log().get_load_stats();
+        std::cout << "Loaded " << load.blogs << " blogs (" << std::fixed << std::setprecision(1)
+                  << static_cast<double>(load.bytes) / (1024.0 * 1024.0) << " MB) in " << load.seconds * 1000.0 << " ms, "
+                  << load.megabytes_per_second() << " MB/s on " << load.threads << " thread(s)" << std::endl;
+        if (load.legacy_text)
+            std::cout << "Migrated " << text_db_path << " to the escaped text format" << std::endl;
+
         auto server = std::make_unique<hh_web::web_server<>>(port);
 
         // Set up the router
@@ -30,7 +96,10 @@ int main()
         server->use_router(router);
         server->use_router(api);
 
-        server->use_static("static");
+        // Static files are loaded (and compressed) once and served from memory
+        static_assets().set_cache_control("/", "public, max-age=86400");
+        static_assets().load_directory(CPP_PROJECT_SOURCE_DIR + std::string("static"));
+        server->use_router(make_static_router());
 
         server->listen([port]
                        { std::cout << "Server is listening at: http://localhost:" + std::to_string(port) << std::endl; });
@@ -0,0 +1,196 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Single-pass scanner behind check_body.
+//
+// check_body used to lower-case the body, split it on ' ' and then run every pattern
+// over every token. The same decision is made here in one linear pass with no allocations:
+//   - substring patterns: an Aho-Corasick automaton (patterns never contain ' ',
+//     so a match inside the body is always a match inside a token)
+//   - whole-token patterns: a trie walked along the current token, checked at each ' ' and at the end
+//   - runs of more than MAX_SPECIAL_RUN special characters
+// Case folding is built into the transition tables. As before, patterns containing
+// upper-case letters can never match the folded input, and whole-token patterns
+// containing ' ' can never equal a token.
+class BodyScanner
+{
+    static constexpr int MAX_SPECIAL_RUN = 5;
+    static constexpr int32_t DEAD = -1;
+
+    std::vector<std::array<int32_t, 256>> substring_next;
+    std::vector<bool> substring_accepts;
+
+    std::vector<std::array<int32_t, 256>> token_next;
+    std::vector<bool> token_accepts;
+
+    std::array<bool, 256> special{};
+
+    static unsigned char fold(unsigned char c)
+    {
+        return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+    }
+
+    static bool can_match_folded(const std::string &pattern)
+    {
+        for (unsigned char c : pattern)
+        {
+            if (c >= 'A' && c <= 'Z')
+                return false;
+        }
+        return !pattern.empty();
+    }
+
+    static int32_t add_state(std::vector<std::array<int32_t, 256>> &next, std::vector<bool> &accepts)
+    {
+        std::array<int32_t, 256> row;
+        row.fill(DEAD);
+        next.push_back(row);
+        accepts.push_back(false);
+        return static_cast<int32_t>(next.size() - 1);
+    }
+
+    static void insert(std::vector<std::array<int32_t, 256>> &next, std::vector<bool> &accepts, const std::string &pattern)
+    {
+        int32_t state = 0;
+        for (unsigned char c : pattern)
+        {
+            if (next[state][c] == DEAD)
+            {
+                int32_t created = add_state(next, accepts);
+                next[state][c] = created;
+            }
+            state = next[state][c];
+        }
+        accepts[state] = true;
+    }
+
+    // Upper-case input bytes take the same edge as their lower-case letter
+    static void fold_rows(std::vector<std::array<int32_t, 256>> &next)
+    {
+        for (auto &row : next)
+        {
+            for (int c = 'A'; c <= 'Z'; c++)
+            {
+                row[c] = row[fold(static_cast<unsigned char>(c))];
+            }
+        }
+    }
+
+    void build_substring_automaton(const std::vector<std::string> &patterns)
+    {
+        add_state(substring_next, substring_accepts);
+        for (const auto &pattern : patterns)
+        {
+            if (can_match_folded(pattern))
+                insert(substring_next, substring_accepts, pattern);
+        }
+
+        // Breadth-first failure links, turned into a complete transition table
+        std::vector<int32_t> failure(substring_next.size(), 0);
+        std::queue<int32_t> pending;
+        for (int c = 0; c < 256; c++)
+        {
+            int32_t child = substring_next[0][c];
+            if (child == DEAD)
+            {
+                substring_next[0][c] = 0;
+            }
+            else
+            {
+                failure[child] = 0;
+                pending.push(child);
+            }
+        }
+
+        while (!pending.empty())
+        {
+            int32_t state = pending.front();
+            pending.pop();
+            if (substring_accepts[failure[state]])
+                substring_accepts[state] = true;
+
+            for (int c = 0; c < 256; c++)
+            {
+                int32_t child = substring_next[state][c];
+                if (child == DEAD)
+                {
+                    substring_next[state][c] = substring_next[failure[state]][c];
+                }
+                else
+                {
+                    failure[child] = substring_next[failure[state]][c];
+                    pending.push(child);
+                }
+            }
+        }
+
+        fold_rows(substring_next);
+    }
+
+    void build_token_trie(const std::vector<std::string> &patterns)
+    {
+        add_state(token_next, token_accepts);
+        for (const auto &pattern : patterns)
+        {
+            if (can_match_folded(pattern) && pattern.find(' ') == std::string::npos)
+                insert(token_next, token_accepts, pattern);
+        }
+        fold_rows(token_next);
+    }
+
+public:
+    BodyScanner(const std::vector<std::string> &substring_patterns,
+                const std::vector<std::string> &token_patterns,
+                const std::string &special_characters)
+    {
+        build_substring_automaton(substring_patterns);
+        build_token_trie(token_patterns);
+        for (unsigned char c : special_characters)
+        {
+            special[c] = true;
+        }
+    }
+
+    // True if the body would be rejected
+    bool is_suspicious(std::string_view body) const
+    {
+        int32_t substring_state = 0;
+        int32_t token_state = 0;
+        int special_run = 0;
+
+        for (unsigned char c : body)
+        {
+            substring_state = substring_next[substring_state][c];
+            if (substring_accepts[substring_state])
+                return true;
+
+            if (c == ' ')
+            {
+                if (token_state != DEAD && token_accepts[token_state])
+                    return true;
+                token_state = 0;
+            }
+            else if (token_state != DEAD)
+            {
+                token_state = token_next[token_state][c];
+            }
+
+            if (special[c])
+            {
+                if (++special_run > MAX_SPECIAL_RUN)
+                    return true;
+            }
+            else
+            {
+                special_run = 0;
+            }
+        }
+
+        return token_state != DEAD && token_accepts[token_state];
+    }
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "../library/web-lib.hpp"
+#include "body_scanner.hpp"
 // Middleware for admin authentication
 hh_web::exit_code admin_auth(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
 {
@@ -25,10 +26,11 @@ hh_web::exit_code admin_auth(std::shared_ptr<hh_web::web_request> req, std::shar
     return hh_web::exit_code::CONTINUE;
 }
 
-hh_web::exit_code check_body(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+// Builds the scanner for check_body once, the pattern lists are compiled into its tables
+const BodyScanner &body_scanner()
 {
-    // Check for common XSS attack patterns
-    const std::vector<std::string> xss_patterns = {
+    // Check for common XSS attack patterns (anywhere in the body)
+    static const std::vector<std::string> xss_patterns = {
         "<script>", "</script>",
         "javascript:", "javascript%3A",
         "onerror=", "onload=", "onclick=", "onmouseover=",
@@ -36,8 +38,8 @@ hh_web::exit_code check_body(std::shared_ptr<hh_web::web_request> req, std::shar
         "fromCharCode", "String.fromCharCode",
         "alert(", "prompt(", "confirm("};
 
-    // Check for SQL injection patterns
-    const std::vector<std::string> sql_patterns = {
+    // Check for SQL injection patterns (whole space-separated tokens)
+    static const std::vector<std::string> sql_patterns = {
         "SELECT", "UPDATE", "DELETE", "INSERT", "DROP",
         "UNION", "JOIN", "WHERE",
         "--", "/*", "*/",
@@ -45,89 +47,32 @@ hh_web::exit_code check_body(std::shared_ptr<hh_web::web_request> req, std::shar
         "SLEEP(", "BENCHMARK(",
         "information_schema"};
 
-    // Check for command injection patterns
-    const std::vector<std::string> cmd_patterns = {
+    // Check for command injection patterns (whole space-separated tokens)
+    static const std::vector<std::string> cmd_patterns = {
         "`", "&&", "||", ";", "|",
         "$(", ">${",
         "/etc/passwd", "/bin/sh", "/bin/bash",
         "curl", "wget", "nc ", "netcat"};
 
-    bool XSS = true;
-    bool SQL = true;
-    bool CMD = true;
+    static const BodyScanner scanner = []
+    {
+        std::vector<std::string> token_patterns = sql_patterns;
+        token_patterns.insert(token_patterns.end(), cmd_patterns.begin(), cmd_patterns.end());
 
-    auto body = req->get_body();
-    std::transform(body.begin(), body.end(), body.begin(),
-                   [](unsigned char c)
-                   { return std::tolower(c); });
+        // Runs of these characters might be encoded attacks
+        return BodyScanner(xss_patterns, token_patterns, "%\\+&<>=\"'");
+    }();
 
-    // tokenize the lowercase body
-    std::istringstream iss(body);
-    std::vector<std::string> tokens;
-    std::string token;
-    while (std::getline(iss, token, ' '))
-    {
-        tokens.push_back(token);
-    }
-    for (auto &t : tokens)
-    {
-        std::transform(t.begin(), t.end(), t.begin(),
-                       [](unsigned char c)
-                       { return std::tolower(c); });
-    }
+    return scanner;
+}
 
-    for (auto &t : tokens)
+hh_web::exit_code check_body(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    if (body_scanner().is_suspicious(req->get_body()))
     {
-        if (XSS)
-            for (const auto &pattern : xss_patterns)
-            {
-                if (t.find(pattern) != std::string::npos)
-                {
-                    res->set_status(400, "Bad Request");
-                    res->send_text("Invalid input detected");
-                    return hh_web::exit_code::EXIT;
-                }
-            }
-        if (SQL)
-            for (const auto &pattern : sql_patterns)
-            {
-                if (t == pattern)
-                {
-                    res->set_status(400, "Bad Request");
-                    res->send_text("Invalid input detected");
-                    return hh_web::exit_code::EXIT;
-                }
-            }
-        if (CMD)
-            for (const auto &pattern : cmd_patterns)
-            {
-                if (t == pattern)
-                {
-                    res->set_status(400, "Bad Request");
-                    res->send_text("Invalid input detected");
-                    return hh_web::exit_code::EXIT;
-                }
-            }
-
-        // Check for unusual character sequences that might be encoded attacks
-        int consecutive_special_chars = 0;
-        for (char c : body)
-        {
-            if (c == '%' || c == '\\' || c == '+' || c == '&' || c == '<' || c == '>' || c == '=' || c == '"' || c == '\'')
-            {
-                consecutive_special_chars++;
-                if (consecutive_special_chars > 5)
-                {
-                    res->set_status(400, "Bad Request");
-                    res->send_text("Invalid input detected");
-                    return hh_web::exit_code::EXIT;
-                }
-            }
-            else
-            {
-                consecutive_special_chars = 0;
-            }
-        }
+        res->set_status(400, "Bad Request");
+        res->send_text("Invalid input detected");
+        return hh_web::exit_code::EXIT;
     }
     return hh_web::exit_code::CONTINUE;
 };
@@ -0,0 +1,252 @@
+#pragma once
+#include "models.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+#include <optional>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Versioned binary snapshot format for blogs, read through mmap.
+//
+//   header  : magic "HHBLOGDB" | u32 version | u32 reserved | u64 count | u64 index_offset
+//   records : per blog, four length-prefixed fields (u32 length + bytes):
+//             title, content, preview_content, created_at
+//   index   : count fixed-width entries { i64 id | u64 offset | u64 length }, sorted by id
+//
+// Records are laid out in listing order, so ordering entries by offset gives the listing.
+// Integers are stored in host byte order.
+namespace blog_binary_format
+{
+    constexpr char MAGIC[8] = {'H', 'H', 'B', 'L', 'O', 'G', 'D', 'B'};
+    constexpr uint32_t VERSION = 1;
+
+    struct header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t count;
+        uint64_t index_offset;
+    };
+
+    struct index_entry
+    {
+        int64_t id;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    static_assert(sizeof(header) == 32, "blog binary header must stay 32 bytes");
+    static_assert(sizeof(index_entry) == 24, "blog binary index entry must stay 24 bytes");
+}
+
+class BlogBinaryFile
+{
+    int fd = -1;
+    const char *data = nullptr;
+    size_t size = 0;
+    const blog_binary_format::header *head = nullptr;
+    const blog_binary_format::index_entry *entries = nullptr;
+
+    static void append_field(std::string &out, std::string_view field)
+    {
+        uint32_t length = static_cast<uint32_t>(field.size());
+        out.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        out.append(field);
+    }
+
+    // The field as a view into the mapping, copied once when the Blog is built
+    bool read_field(uint64_t &pos, uint64_t end, std::string_view &out) const
+    {
+        uint32_t length;
+        if (pos + sizeof(length) > end)
+            return false;
+        std::memcpy(&length, data + pos, sizeof(length));
+        pos += sizeof(length);
+        if (pos + length > end)
+            return false;
+        out = std::string_view(data + pos, length);
+        pos += length;
+        return true;
+    }
+
+    Blog decode(const blog_binary_format::index_entry &entry) const
+    {
+        uint64_t pos = entry.offset;
+        uint64_t end = entry.offset + entry.length;
+        std::string_view title, content, preview_content, created_at;
+        if (end > size ||
+            !read_field(pos, end, title) ||
+            !read_field(pos, end, content) ||
+            !read_field(pos, end, preview_content) ||
+            !read_field(pos, end, created_at))
+        {
+            throw std::runtime_error("Corrupt blog record " + std::to_string(entry.id));
+        }
+        return Blog(static_cast<int>(entry.id), title, std::string(content), preview_content, created_at);
+    }
+
+public:
+    BlogBinaryFile() = default;
+    BlogBinaryFile(const BlogBinaryFile &) = delete;
+    BlogBinaryFile &operator=(const BlogBinaryFile &) = delete;
+
+    ~BlogBinaryFile()
+    {
+        close();
+    }
+
+    // Maps the file, returns false if it does not exist. Throws on a malformed file.
+    bool open(const std::string &path)
+    {
+        close();
+
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            close();
+            throw std::runtime_error("Cannot stat " + path);
+        }
+        size = static_cast<size_t>(st.st_size);
+        if (size < sizeof(blog_binary_format::header))
+        {
+            close();
+            throw std::runtime_error("Truncated blog file " + path);
+        }
+
+        void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close();
+            throw std::runtime_error("Cannot mmap " + path);
+        }
+        data = static_cast<const char *>(mapped);
+        head = reinterpret_cast<const blog_binary_format::header *>(data);
+
+        if (std::memcmp(head->magic, blog_binary_format::MAGIC, sizeof(head->magic)) != 0 ||
+            head->version != blog_binary_format::VERSION ||
+            head->index_offset > size ||
+            head->count > (size - head->index_offset) / sizeof(blog_binary_format::index_entry))
+        {
+            close();
+            throw std::runtime_error("Invalid blog file " + path);
+        }
+        entries = reinterpret_cast<const blog_binary_format::index_entry *>(data + head->index_offset);
+        return true;
+    }
+
+    void close()
+    {
+        if (data)
+            ::munmap(const_cast<char *>(data), size);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+        data = nullptr;
+        size = 0;
+        head = nullptr;
+        entries = nullptr;
+    }
+
+    size_t file_size() const { return size; }
+
+    size_t count() const
+    {
+        return head ? static_cast<size_t>(head->count) : 0;
+    }
+
+    // Binary search over the index, only the index pages and the record itself are touched.
+    // For tooling: the server loads everything with load_all() and serves reads from memory.
+    std::optional<Blog> find(int id) const
+    {
+        if (!head)
+            return std::nullopt;
+
+        auto begin = entries;
+        auto end = entries + head->count;
+        auto it = std::lower_bound(begin, end, static_cast<int64_t>(id),
+                                   [](const blog_binary_format::index_entry &entry, int64_t key)
+                                   { return entry.id < key; });
+        if (it == end || it->id != id)
+            return std::nullopt;
+        return decode(*it);
+    }
+
+    // All blogs in listing order
+    std::vector<Blog> load_all() const
+    {
+        std::vector<Blog> blogs;
+        if (!head)
+            return blogs;
+
+        std::vector<const blog_binary_format::index_entry *> ordered;
+        ordered.reserve(head->count);
+        for (uint64_t i = 0; i < head->count; i++)
+        {
+            ordered.push_back(entries + i);
+        }
+        std::sort(ordered.begin(), ordered.end(), [](auto a, auto b)
+                  { return a->offset < b->offset; });
+
+        blogs.reserve(ordered.size());
+        for (auto entry : ordered)
+        {
+            blogs.push_back(decode(*entry));
+        }
+        return blogs;
+    }
+
+    // Writes blogs (in listing order) to path
+    static void write(const std::string &path, const std::vector<Blog> &blogs)
+    {
+        std::string out(sizeof(blog_binary_format::header), '\0');
+        std::vector<blog_binary_format::index_entry> index;
+        index.reserve(blogs.size());
+
+        for (const auto &blog : blogs)
+        {
+            blog_binary_format::index_entry entry;
+            entry.id = blog.get_id();
+            entry.offset = out.size();
+            append_field(out, blog.get_title());
+            append_field(out, blog.get_content());
+            append_field(out, blog.get_preview_content());
+            append_field(out, blog.get_created_at());
+            entry.length = out.size() - entry.offset;
+            index.push_back(entry);
+        }
+
+        std::sort(index.begin(), index.end(), [](const auto &a, const auto &b)
+                  { return a.id < b.id; });
+
+        // Keep the index 8-byte aligned so entries can be read in place
+        out.resize((out.size() + 7) & ~static_cast<size_t>(7), '\0');
+
+        blog_binary_format::header head;
+        std::memcpy(head.magic, blog_binary_format::MAGIC, sizeof(head.magic));
+        head.version = blog_binary_format::VERSION;
+        head.reserved = 0;
+        head.count = index.size();
+        head.index_offset = out.size();
+        std::memcpy(&out[0], &head, sizeof(head));
+
+        out.append(reinterpret_cast<const char *>(index.data()), index.size() * sizeof(blog_binary_format::index_entry));
+
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(out.data(), static_cast<std::streamsize>(out.size()));
+        file.close();
+        if (!file)
+        {
+            throw std::runtime_error("Cannot write blog file " + path);
+        }
+    }
+};
@@ -0,0 +1,571 @@
+#pragma once
+#include "models.hpp"
+#include "blog_binary_file.hpp"
+#include "blog_text_file.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// On-disk format of the snapshot the log is compacted into
+enum class snapshot_format
+{
+    text,  // pipe-delimited lines, Blog::to_string_for_file
+    binary // mmap-able, see blog_binary_file.hpp
+};
+
+// How reading the snapshot went at startup, for the load report
+struct snapshot_load_stats
+{
+    size_t blogs = 0;
+    size_t bytes = 0;
+    unsigned threads = 0;
+    double seconds = 0;
+    bool legacy_text = false; // text snapshot from before fields were escaped, see BlogTextFile::is_legacy
+
+    double megabytes_per_second() const
+    {
+        return seconds > 0 ? static_cast<double>(bytes) / (1024.0 * 1024.0) / seconds : 0;
+    }
+};
+
+// Append-only write-ahead log on top of the blogs.db snapshot.
+//
+// Every batch of writes is appended to <snapshot>.log and fsynced once:
+//   P <id> <title_len> <content_len> <preview_len> <created_at_len> <checksum>\n<fields...>\n
+//   D <id>\n
+// Startup loads the snapshot and replays the log over it. Once enough of the
+// records on disk are dead (overwritten or deleted), a background thread writes
+// a fresh snapshot, publishes it with rename() and drops the replayed prefix of the log.
+class BlogLog
+{
+    std::string snapshot_path;
+    std::string log_path;
+    snapshot_format format = snapshot_format::text;
+    int fd = -1;
+
+    std::mutex mutex;
+    size_t snapshot_records = 0;
+    size_t log_records = 0;
+    size_t live_records = 0;
+    snapshot_load_stats load_stats;
+
+    double max_dead_ratio = 0.5;
+    size_t min_records_to_compact = 256;
+
+    // Supplies the current live blogs when the compactor needs a snapshot
+    std::function<std::vector<Blog>()> live_blogs;
+
+    std::thread compactor;
+    std::condition_variable compactor_cv;
+    bool compaction_requested = false;
+    bool stopping = false;
+
+    static uint32_t checksum(const std::string &data, size_t from)
+    {
+        // FNV-1a, enough to detect torn or garbage tails
+        uint32_t hash = 2166136261u;
+        for (size_t i = from; i < data.size(); i++)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    static bool write_all(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t written = ::write(fd, data, size);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+
+    static bool read_file(const std::string &path, std::string &out)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        out.assign((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    // Throws when the data cannot be made durable, the caller must not drop what it replaces
+    static void fsync_path(const std::string &path)
+    {
+        int file_fd = ::open(path.c_str(), O_RDONLY);
+        if (file_fd < 0)
+            throw std::runtime_error("Cannot open " + path + " to sync it");
+        bool synced = ::fsync(file_fd) == 0;
+        ::close(file_fd);
+        if (!synced)
+            throw std::runtime_error("Cannot sync " + path);
+    }
+
+    static std::string parent_directory(const std::string &path)
+    {
+        auto slash = path.find_last_of('/');
+        return slash == std::string::npos ? "." : path.substr(0, slash + 1);
+    }
+
+    // Applies every complete record in data[from..] to blogs, returns the offset of the first unreadable byte
+    static size_t replay(const std::string &data, size_t from, std::unordered_map<int, size_t> &positions,
+                         std::vector<std::optional<Blog>> &slots, size_t &records)
+    {
+        size_t pos = from;
+        while (pos < data.size())
+        {
+            size_t line_end = data.find('\n', pos);
+            if (line_end == std::string::npos)
+                break;
+
+            std::istringstream header(data.substr(pos, line_end - pos));
+            char kind = 0;
+            int id = 0;
+            if (!(header >> kind >> id))
+                break;
+
+            if (kind == 'D')
+            {
+                auto it = positions.find(id);
+                if (it != positions.end())
+                {
+                    slots[it->second].reset();
+                    positions.erase(it);
+                }
+                pos = line_end + 1;
+                records++;
+                continue;
+            }
+
+            size_t lengths[4];
+            uint32_t expected = 0;
+            if (kind != 'P' || !(header >> lengths[0] >> lengths[1] >> lengths[2] >> lengths[3] >> expected))
+                break;
+
+            size_t payload_start = line_end + 1;
+            size_t payload_size = lengths[0] + lengths[1] + lengths[2] + lengths[3];
+            if (payload_start + payload_size + 1 > data.size() || data[payload_start + payload_size] != '\n')
+                break;
+
+            std::string payload = data.substr(payload_start, payload_size);
+            if (checksum(payload, 0) != expected)
+                break;
+
+            size_t offset = 0;
+            std::string fields[4];
+            for (int i = 0; i < 4; i++)
+            {
+                fields[i] = payload.substr(offset, lengths[i]);
+                offset += lengths[i];
+            }
+
+            Blog blog(id, fields[0], fields[1], fields[2], fields[3]);
+            auto it = positions.find(id);
+            if (it != positions.end())
+            {
+                slots[it->second] = blog;
+            }
+            else
+            {
+                positions[id] = slots.size();
+                slots.emplace_back(blog);
+            }
+
+            pos = payload_start + payload_size + 1;
+            records++;
+        }
+        return pos;
+    }
+
+    struct recovered_state
+    {
+        std::vector<Blog> blogs;
+        size_t snapshot_records = 0;
+        size_t log_records = 0;
+        size_t log_bytes = 0;
+        size_t log_valid_bytes = 0;
+        snapshot_load_stats load_stats;
+    };
+
+    // Loads the snapshot and replays its log over it, without touching either file
+    static recovered_state recover(const std::string &path, snapshot_format format)
+    {
+        recovered_state state;
+        auto snapshot = read_snapshot(path, format, &state.load_stats);
+        state.snapshot_records = snapshot.size();
+
+        std::unordered_map<int, size_t> positions;
+        std::vector<std::optional<Blog>> slots;
+        positions.reserve(snapshot.size());
+        slots.reserve(snapshot.size());
+        for (auto &blog : snapshot)
+        {
+            positions[blog.get_id()] = slots.size();
+            slots.emplace_back(std::move(blog));
+        }
+
+        std::string data;
+        if (read_file(path + ".log", data))
+        {
+            state.log_bytes = data.size();
+            state.log_valid_bytes = replay(data, 0, positions, slots, state.log_records);
+        }
+
+        state.blogs.reserve(positions.size());
+        for (auto &slot : slots)
+        {
+            if (slot)
+                state.blogs.push_back(std::move(*slot));
+        }
+        return state;
+    }
+
+
+    bool should_compact() const
+    {
+        size_t total = snapshot_records + log_records;
+        if (total < min_records_to_compact || total <= live_records)
+            return false;
+        return static_cast<double>(total - live_records) / static_cast<double>(total) > max_dead_ratio;
+    }
+
+    void compactor_loop()
+    {
+        std::unique_lock lock(mutex);
+        while (true)
+        {
+            compactor_cv.wait(lock, [this]
+                              { return stopping || compaction_requested; });
+            if (stopping)
+                return;
+            compaction_requested = false;
+
+            lock.unlock();
+            try
+            {
+                compact();
+            }
+            catch (const std::exception &e)
+            {
+                hh_web::logger::error(std::string("Blog log compaction failed: ") + e.what());
+            }
+            lock.lock();
+        }
+    }
+
+public:
+    BlogLog() = default;
+    BlogLog(const BlogLog &) = delete;
+    BlogLog &operator=(const BlogLog &) = delete;
+
+    ~BlogLog()
+    {
+        close();
+    }
+
+    // Snapshot read of the last open()
+    snapshot_load_stats get_load_stats()
+    {
+        std::lock_guard lock(mutex);
+        return load_stats;
+    }
+
+    void set_compaction_policy(double dead_ratio, size_t min_records)
+    {
+        std::lock_guard lock(mutex);
+        max_dead_ratio = dead_ratio;
+        min_records_to_compact = min_records;
+    }
+
+    static std::vector<Blog> read_snapshot(const std::string &path, snapshot_format format, snapshot_load_stats *stats = nullptr)
+    {
+        auto started = std::chrono::steady_clock::now();
+        std::vector<Blog> blogs;
+        size_t bytes = 0;
+        unsigned threads = 1;
+        bool legacy_text = false;
+        if (format == snapshot_format::binary)
+        {
+            BlogBinaryFile file;
+            if (file.open(path))
+            {
+                blogs = file.load_all();
+                bytes = file.file_size();
+            }
+        }
+        else
+        {
+            BlogTextFile file;
+            if (file.open(path))
+            {
+                blogs = file.load_all();
+                bytes = file.file_size();
+                threads = file.get_threads_used();
+                legacy_text = file.is_legacy();
+            }
+        }
+
+        if (stats)
+        {
+            stats->blogs = blogs.size();
+            stats->bytes = bytes;
+            stats->threads = threads;
+            stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            stats->legacy_text = legacy_text;
+        }
+        return blogs;
+    }
+
+    static void write_snapshot(const std::string &path, snapshot_format format, const std::vector<Blog> &blogs)
+    {
+        if (format == snapshot_format::binary)
+            BlogBinaryFile::write(path, blogs);
+        else
+            Blog::save_blogs_to_file(path, blogs);
+    }
+
+    // Rewrites the state of one snapshot (+ its log) into another format and starts that one with an empty log
+    static size_t convert(const std::string &from_path, snapshot_format from_format,
+                          const std::string &to_path, snapshot_format to_format)
+    {
+        auto state = recover(from_path, from_format);
+        replace_snapshot(to_path, to_format, state.blogs);
+        return state.blogs.size();
+    }
+
+    // Publishes blogs as the snapshot at path and empties its log
+    static void replace_snapshot(const std::string &path, snapshot_format format, const std::vector<Blog> &blogs)
+    {
+        std::string tmp_path = path + ".tmp";
+        write_snapshot(tmp_path, format, blogs);
+        fsync_path(tmp_path);
+        if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+        {
+            throw std::runtime_error("Cannot publish snapshot " + path);
+        }
+
+        // A log left behind would replay over the new snapshot on the next start
+        std::string log_file = path + ".log";
+        if (::truncate(log_file.c_str(), 0) == 0)
+            fsync_path(log_file);
+        else if (errno != ENOENT && ::unlink(log_file.c_str()) != 0)
+            throw std::runtime_error("Cannot empty log " + log_file);
+        fsync_path(parent_directory(path));
+    }
+
+    // Loads the snapshot, replays the log over it and starts the background compactor.
+    // live_blogs_provider must return the current live set without calling back into the log,
+    // including every record appended before the call (it waits for a batch being published).
+    std::vector<Blog> open(const std::string &path, std::function<std::vector<Blog>()> live_blogs_provider,
+                           snapshot_format snapshot_format_to_use = snapshot_format::text)
+    {
+        close();
+
+        snapshot_path = path;
+        log_path = path + ".log";
+        format = snapshot_format_to_use;
+        live_blogs = std::move(live_blogs_provider);
+
+        auto state = recover(snapshot_path, format);
+        if (state.load_stats.legacy_text)
+        {
+            // Its values were just decoded as form input, rewrite it so the next start does not do that again
+            replace_snapshot(snapshot_path, format, state.blogs);
+            state.snapshot_records = state.blogs.size();
+            state.log_records = 0;
+            state.log_bytes = state.log_valid_bytes = 0;
+        }
+        if (state.log_valid_bytes < state.log_bytes)
+        {
+            // Torn write from a crash, drop the tail so new records follow a valid one
+            hh_web::logger::error("Blog log: discarding " + std::to_string(state.log_bytes - state.log_valid_bytes) + " bytes of incomplete records");
+            if (::truncate(log_path.c_str(), static_cast<off_t>(state.log_valid_bytes)) != 0)
+            {
+                throw std::runtime_error("Cannot drop incomplete records from " + log_path);
+            }
+        }
+
+        fd = ::open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (fd < 0)
+        {
+            throw std::runtime_error("Cannot open blog log: " + log_path);
+        }
+
+        {
+            std::lock_guard lock(mutex);
+            snapshot_records = state.snapshot_records;
+            log_records = state.log_records;
+            live_records = state.blogs.size();
+            load_stats = state.load_stats;
+            stopping = false;
+            compaction_requested = false;
+        }
+        compactor = std::thread(&BlogLog::compactor_loop, this);
+
+        return std::move(state.blogs);
+    }
+
+    void close()
+    {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        compactor_cv.notify_all();
+        if (compactor.joinable())
+            compactor.join();
+
+        std::lock_guard lock(mutex);
+        if (fd >= 0)
+        {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    // One put record, carries the whole blog
+    static std::string encode_put(const Blog &blog)
+    {
+        std::string payload;
+        payload.reserve(blog.get_title().size() + blog.get_content().size() + blog.get_preview_content().size() +
+                        blog.get_created_at().size());
+        payload.append(blog.get_title()).append(blog.get_content()).append(blog.get_preview_content()).append(blog.get_created_at());
+        std::string record = "P " + std::to_string(blog.get_id()) + " " +
+                             std::to_string(blog.get_title().size()) + " " +
+                             std::to_string(blog.get_content().size()) + " " +
+                             std::to_string(blog.get_preview_content().size()) + " " +
+                             std::to_string(blog.get_created_at().size()) + " " +
+                             std::to_string(checksum(payload, 0)) + "\n";
+        record.reserve(record.size() + payload.size() + 1);
+        record += payload;
+        record += '\n';
+        return record;
+    }
+
+    static std::string encode_delete(int id)
+    {
+        return "D " + std::to_string(id) + "\n";
+    }
+
+    // Appends records (one or more encoded records back to back) with a single write and fdatasync.
+    // A failed batch is cut off again, so it neither hides the batches after it from replay nor
+    // comes back on restart. When even that fails the log stops taking writes.
+    bool append_batch(const std::string &records, size_t record_count)
+    {
+        std::lock_guard lock(mutex);
+        if (fd < 0)
+            return false;
+        off_t start = ::lseek(fd, 0, SEEK_END);
+        if (start < 0)
+            return false;
+        if (write_all(fd, records.data(), records.size()) && ::fdatasync(fd) == 0)
+        {
+            log_records += record_count;
+            return true;
+        }
+
+        if (::ftruncate(fd, start) != 0 || ::fdatasync(fd) != 0)
+        {
+            hh_web::logger::error("Blog log: cannot roll back a failed append, refusing further writes to " + log_path);
+            ::close(fd);
+            fd = -1;
+        }
+        return false;
+    }
+
+    // Called after each write with the number of live blogs, wakes the compactor when the log is mostly dead records
+    void maybe_compact(size_t live_count)
+    {
+        {
+            std::lock_guard lock(mutex);
+            live_records = live_count;
+            if (!should_compact())
+                return;
+            compaction_requested = true;
+        }
+        compactor_cv.notify_one();
+    }
+
+    // Writes a fresh snapshot and keeps only the log records appended while it was being written.
+    // Replaying a record twice is harmless (puts carry the full blog, deletes are idempotent),
+    // so the snapshot only has to be taken after the log offset is recorded and hold every
+    // record before it, which live_blogs guarantees.
+    void compact()
+    {
+        off_t replayed_offset;
+        {
+            std::lock_guard lock(mutex);
+            if (fd < 0)
+                return;
+            replayed_offset = ::lseek(fd, 0, SEEK_END);
+        }
+
+        auto blogs = live_blogs();
+
+        std::string tmp_snapshot = snapshot_path + ".tmp";
+        write_snapshot(tmp_snapshot, format, blogs);
+        fsync_path(tmp_snapshot);
+        if (std::rename(tmp_snapshot.c_str(), snapshot_path.c_str()) != 0)
+        {
+            throw std::runtime_error("Cannot publish snapshot " + snapshot_path);
+        }
+        fsync_path(parent_directory(snapshot_path));
+
+        std::lock_guard lock(mutex);
+        std::string data;
+        read_file(log_path, data);
+        std::string tail = static_cast<size_t>(replayed_offset) < data.size() ? data.substr(replayed_offset) : std::string();
+
+        // Opened for appending, so once renamed it simply becomes the log's descriptor
+        std::string tmp_log = log_path + ".tmp";
+        int tmp_fd = ::open(tmp_log.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if (tmp_fd < 0 || !write_all(tmp_fd, tail.data(), tail.size()))
+        {
+            if (tmp_fd >= 0)
+                ::close(tmp_fd);
+            throw std::runtime_error("Cannot write compacted log " + tmp_log);
+        }
+        if (::fsync(tmp_fd) != 0)
+        {
+            ::close(tmp_fd);
+            throw std::runtime_error("Cannot sync compacted log " + tmp_log);
+        }
+
+        if (std::rename(tmp_log.c_str(), log_path.c_str()) != 0)
+        {
+            ::close(tmp_fd);
+            throw std::runtime_error("Cannot publish compacted log " + log_path);
+        }
+        ::close(fd);
+        fd = tmp_fd;
+        fsync_path(parent_directory(log_path));
+
+        std::unordered_map<int, size_t> positions;
+        std::vector<std::optional<Blog>> slots;
+        size_t tail_records = 0;
+        replay(tail, 0, positions, slots, tail_records);
+
+        snapshot_records = blogs.size();
+        log_records = tail_records;
+    }
+};
@@ -0,0 +1,697 @@
+#pragma once
+#include "models.hpp"
+#include "blog_log.hpp"
+#include "search_index.hpp"
+#include <optional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <ctime>
+#include <atomic>
+#include <algorithm>
+#include <condition_variable>
+#include <future>
+#include <thread>
+#include <unordered_set>
+
+// Monotonic version of a blog (or of the whole collection) and when it last changed
+struct BlogVersion
+{
+    uint64_t version = 0;
+    std::time_t modified_at = 0;
+};
+
+// A mutation queued for the writer thread
+struct BlogWrite
+{
+    enum class kind
+    {
+        create,
+        update,
+        remove
+    };
+
+    kind type;
+    int id = 0; // update and remove
+    std::string title, content, preview_content, created_at;
+};
+
+// Outcome of a BlogWrite: the blog as written (create/update), found is false when the id does not exist
+struct BlogWriteResult
+{
+    std::optional<Blog> blog;
+    bool found = false;
+};
+
+// Writes submitted together. With all_or_nothing, the group is only applied if every
+// update and delete finds its blog, otherwise none of it is.
+struct BlogWriteGroup
+{
+    std::vector<BlogWrite> writes;
+    bool all_or_nothing = false;
+    std::promise<std::vector<BlogWriteResult>> done;
+    uint64_t trace_request = 0; // the submitter's traced request, the writer records its spans under it
+};
+
+// One page of the listing, next_after is the cursor for the following page (-1 on the last one)
+struct BlogPage
+{
+    std::vector<Blog> blogs;
+    int next_after = -1;
+    BlogVersion version;
+};
+
+// Output derived from one published version of a blog: its article card, its page and its JSON.
+// They are kept for as long as the entry lives, and a write creates a new entry, so an edit never
+// leaves a stale rendering behind. Renderings made from templates carry the template generation
+// they were made at and are built again after a template changes.
+class BlogRenderings
+{
+public:
+    enum kind
+    {
+        article_card,
+        blog_page,
+        blog_json,
+        kind_count
+    };
+
+private:
+    struct rendering
+    {
+        uint64_t generation;
+        std::string text;
+    };
+
+    std::shared_ptr<const rendering> slots[kind_count];
+
+public:
+    // The rendering of kind made at generation, render() builds it when there is none yet or the
+    // stored one is from another generation (a template changed since). Two threads may both
+    // render it, the first to store wins and both return its copy.
+    template <typename Render>
+    std::shared_ptr<const std::string> get(kind which, uint64_t generation, Render &&render)
+    {
+        auto current = std::atomic_load(&slots[which]);
+        while (!current || current->generation != generation)
+        {
+            auto rendered = std::make_shared<const rendering>(rendering{generation, render()});
+            if (std::atomic_compare_exchange_strong(&slots[which], &current, rendered))
+            {
+                current = std::move(rendered);
+                break;
+            }
+        }
+        return std::shared_ptr<const std::string>(current, &current->text);
+    }
+};
+
+// One blog as stored in a snapshot. Blogs are immutable once published,
+// so consecutive snapshots share the entries of blogs that did not change, with their renderings.
+struct BlogEntry
+{
+    std::shared_ptr<const Blog> blog;
+    BlogVersion version;
+    std::shared_ptr<BlogRenderings> renderings = std::make_shared<BlogRenderings>();
+};
+
+// Consecutive entries of a snapshot, valid while the snapshot is held
+struct BlogEntryPage
+{
+    std::vector<const BlogEntry *> entries;
+    int next_after = -1;
+    BlogVersion version;
+};
+
+// An immutable version of the whole collection, sorted by id.
+// Everything read from one snapshot is consistent: a page, its cursor and its ETag belong together.
+//
+// Entries are stored in chunks of at most CHUNK_SIZE. A write copies the chunks it touches and the
+// chunk table, every other chunk is shared with the snapshot before, so neither building a snapshot
+// nor freeing the old one costs time proportional to the whole collection.
+struct BlogSnapshot
+{
+    static constexpr size_t CHUNK_SIZE = 512;
+    using chunk = std::vector<BlogEntry>;
+
+    std::vector<std::shared_ptr<const chunk>> chunks; // in id order, none of them empty
+    size_t entry_count = 0;
+    BlogVersion collection;
+    std::time_t loaded_at = 0; // goes into the ETags so they never repeat across restarts
+
+    // Where an entry is: chunks[chunk_index][index], index 0 of chunks.size() is the end
+    struct position
+    {
+        size_t chunk_index = 0;
+        size_t index = 0;
+    };
+
+    static int id_of(const BlogEntry &entry) { return entry.blog->get_id(); }
+
+    // First chunk whose last id is at least id
+    size_t chunk_not_below(int id) const
+    {
+        return std::lower_bound(chunks.begin(), chunks.end(), id, [](const std::shared_ptr<const chunk> &c, int id)
+                                { return id_of(c->back()) < id; }) -
+               chunks.begin();
+    }
+
+    // Position of the first entry with an id greater than id
+    position upper_bound(int id) const
+    {
+        size_t c = std::upper_bound(chunks.begin(), chunks.end(), id, [](int id, const std::shared_ptr<const chunk> &c)
+                                    { return id < id_of(c->back()); }) -
+                   chunks.begin();
+        if (c == chunks.size())
+            return {c, 0};
+        auto it = std::upper_bound(chunks[c]->begin(), chunks[c]->end(), id, [](int id, const BlogEntry &entry)
+                                   { return id < id_of(entry); });
+        return {c, static_cast<size_t>(it - chunks[c]->begin())};
+    }
+
+    const BlogEntry *find_entry(int id) const
+    {
+        // Last entry with the id, like the old id -> position map when a file repeats an id
+        position after = upper_bound(id);
+        const BlogEntry *entry = nullptr;
+        if (after.index > 0)
+            entry = &(*chunks[after.chunk_index])[after.index - 1];
+        else if (after.chunk_index > 0)
+            entry = &chunks[after.chunk_index - 1]->back();
+        return entry && id_of(*entry) == id ? entry : nullptr;
+    }
+
+    std::optional<Blog> find(int id) const
+    {
+        auto entry = find_entry(id);
+        if (!entry)
+            return std::nullopt;
+        return *entry->blog;
+    }
+
+    // Up to limit entries with an id greater than after_id
+    BlogEntryPage get_entry_page(int after_id, size_t limit) const
+    {
+        BlogEntryPage page;
+        page.version = collection;
+        page.entries.reserve(std::min(limit, entry_count));
+
+        position at = upper_bound(after_id);
+        while (at.chunk_index < chunks.size() && page.entries.size() < limit)
+        {
+            const chunk &c = *chunks[at.chunk_index];
+            size_t take = std::min(c.size() - at.index, limit - page.entries.size());
+            for (size_t i = at.index; i < at.index + take; i++)
+                page.entries.push_back(&c[i]);
+            at.index += take;
+            if (at.index == c.size())
+                at = {at.chunk_index + 1, 0};
+        }
+        if (at.chunk_index < chunks.size() && !page.entries.empty())
+            page.next_after = id_of(*page.entries.back());
+        return page;
+    }
+
+    // Same page as get_entry_page(), as copies of the blogs
+    BlogPage get_page(int after_id, size_t limit) const
+    {
+        auto entries = get_entry_page(after_id, limit);
+        BlogPage page;
+        page.version = entries.version;
+        page.next_after = entries.next_after;
+        page.blogs.reserve(entries.entries.size());
+        for (const BlogEntry *entry : entries.entries)
+            page.blogs.push_back(*entry->blog);
+        return page;
+    }
+
+    template <typename F>
+    void for_each_entry(F &&f) const
+    {
+        for (const auto &c : chunks)
+        {
+            for (const auto &entry : *c)
+                f(entry);
+        }
+    }
+
+    std::vector<Blog> get_all() const
+    {
+        std::vector<Blog> blogs;
+        blogs.reserve(entry_count);
+        for_each_entry([&](const BlogEntry &entry)
+                       { blogs.push_back(*entry.blog); });
+        return blogs;
+    }
+
+    size_t size() const { return entry_count; }
+};
+
+// In-memory blog store, loaded once at startup.
+// New blogs always get a higher id, so the listing is kept sorted by id
+// and an id works as a pagination cursor that is stable under inserts and deletes.
+//
+// Reads never take a lock (RCU style). The collection is published as an immutable BlogSnapshot.
+// Each thread caches the snapshot it last read and only reloads it when the published generation
+// changes, so readers share no cache line but that counter. An old snapshot is freed once no
+// request holds it and every thread that read it has moved on to a newer one.
+//
+// All mutations go through one writer thread (group commit). Callers queue BlogWrites and
+// wait on a future. The writer takes everything queued, applies it in order, appends all
+// records to the blog log with one fsync, and only then publishes the next snapshot and
+// completes the futures. Readers never wait on the disk or on the writer.
+class BlogRepository
+{
+    std::shared_ptr<const BlogSnapshot> published = std::make_shared<const BlogSnapshot>();
+    std::atomic<uint64_t> published_generation{0};
+    uint64_t next_version = 1; // writer thread only
+
+    // Writes waiting for the writer thread
+    std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    std::vector<BlogWriteGroup> queue;
+    bool stopping = false;
+
+    // Full-text index, updated by the writer thread with each batch
+    SearchIndex search_index;
+
+    // Held by the writer from a log append until the batch is published, and by the compactor
+    // while it reads the live set, so a compaction never misses a batch that is already in the log
+    std::mutex log_publish_mutex;
+
+    // Declared after the data and log_publish_mutex so the compactor, which uses both, is stopped
+    // before they go away
+    BlogLog log;
+    std::thread writer;
+
+    // Generations are unique across repositories, so a thread cache never mistakes one for another
+    static uint64_t new_generation()
+    {
+        static std::atomic<uint64_t> counter{0};
+        return counter.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    void publish(std::shared_ptr<const BlogSnapshot> snapshot)
+    {
+        std::atomic_store(&published, std::move(snapshot));
+        published_generation.store(new_generation(), std::memory_order_release);
+    }
+
+    // This thread's copy of the published snapshot. The reference stays valid until the
+    // thread's next call, so each read method calls this exactly once.
+    const std::shared_ptr<const BlogSnapshot> &current() const
+    {
+        struct cached_snapshot
+        {
+            const BlogRepository *owner = nullptr;
+            uint64_t generation = 0;
+            std::shared_ptr<const BlogSnapshot> snapshot;
+        };
+        thread_local cached_snapshot cache;
+
+        uint64_t generation = published_generation.load(std::memory_order_acquire);
+        if (cache.owner != this || cache.generation != generation)
+        {
+            cache.snapshot = std::atomic_load(&published);
+            cache.owner = this;
+            cache.generation = generation;
+        }
+        return cache.snapshot;
+    }
+
+    void writer_loop()
+    {
+        std::unique_lock lock(queue_mutex);
+        while (true)
+        {
+            queue_cv.wait(lock, [this]
+                          { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return; // stopping, and everything queued has been written
+
+            auto batch = std::move(queue);
+            queue.clear();
+            lock.unlock();
+            commit(batch);
+            lock.lock();
+        }
+    }
+
+    using staged_blogs = std::unordered_map<int, std::optional<Blog>>; // id -> new state, nullopt when deleted
+
+    // Blog with id as of the writes staged so far (this group, then the batch), nullopt if it does not exist
+    static std::optional<Blog> staged_or_current(const staged_blogs &group, const staged_blogs &batch,
+                                                 const BlogSnapshot &snapshot, int id)
+    {
+        auto it = group.find(id);
+        if (it != group.end())
+            return it->second;
+        it = batch.find(id);
+        if (it != batch.end())
+            return it->second;
+        return snapshot.find(id);
+    }
+
+    // Stages one group on top of the batch, all_or_nothing groups that miss a blog are dropped whole
+    std::vector<BlogWriteResult> stage_group(const BlogWriteGroup &group, const BlogSnapshot &base, staged_blogs &staged,
+                                             std::vector<int> &touched, std::string &records, size_t &record_count)
+    {
+        std::vector<BlogWriteResult> results(group.writes.size());
+        staged_blogs group_staged;
+        std::vector<int> group_touched;
+        std::string group_records;
+        size_t group_count = 0;
+        bool missing = false;
+
+        for (size_t i = 0; i < group.writes.size(); i++)
+        {
+            const BlogWrite &write = group.writes[i];
+            BlogWriteResult &result = results[i];
+
+            if (write.type == BlogWrite::kind::create)
+            {
+                Blog blog(write.title, write.content, write.preview_content, write.created_at);
+                group_records += BlogLog::encode_put(blog);
+                group_touched.push_back(blog.get_id());
+                result = {blog, true};
+                group_staged.insert_or_assign(blog.get_id(), std::move(blog));
+            }
+            else
+            {
+                auto blog = staged_or_current(group_staged, staged, base, write.id);
+                if (!blog)
+                {
+                    missing = true;
+                    continue;
+                }
+
+                if (write.type == BlogWrite::kind::update)
+                {
+                    blog->set_title(write.title);
+                    blog->set_content(write.content);
+                    blog->set_preview_content(write.preview_content);
+                    group_records += BlogLog::encode_put(*blog);
+                    result = {blog, true};
+                    group_staged.insert_or_assign(write.id, std::move(blog));
+                }
+                else
+                {
+                    group_records += BlogLog::encode_delete(write.id);
+                    result.found = true;
+                    group_staged.insert_or_assign(write.id, std::nullopt);
+                }
+                group_touched.push_back(write.id);
+            }
+            group_count++;
+        }
+
+        if (missing && group.all_or_nothing)
+            return results;
+
+        for (auto &[id, state] : group_staged)
+            staged.insert_or_assign(id, std::move(state));
+        touched.insert(touched.end(), group_touched.begin(), group_touched.end());
+        records += group_records;
+        record_count += group_count;
+        return results;
+    }
+
+    void commit(std::vector<BlogWriteGroup> &batch)
+    {
+        auto base = current();
+        staged_blogs staged;
+        std::vector<int> touched; // ids in write order, for the versions
+        std::vector<std::vector<BlogWriteResult>> results;
+        std::string records;
+        size_t record_count = 0;
+
+        // The writer runs outside any request, its spans go to every traced request of the batch
+        std::vector<uint64_t> traced;
+        for (const auto &group : batch)
+        {
+            if (group.trace_request)
+                traced.push_back(group.trace_request);
+        }
+
+        results.reserve(batch.size());
+        {
+            TRACE_SHARED_SPAN("write_stage", traced);
+            for (const auto &group : batch)
+            {
+                results.push_back(stage_group(group, *base, staged, touched, records, record_count));
+            }
+        }
+
+        std::unique_lock log_publish_lock(log_publish_mutex);
+        bool appended;
+        {
+            TRACE_SHARED_SPAN("log_append_batch", traced);
+            appended = record_count == 0 || log.append_batch(records, record_count);
+        }
+        if (!appended)
+        {
+            for (auto &group : batch)
+                group.done.set_exception(std::make_exception_ptr(std::runtime_error("Failed to write blog log")));
+            return;
+        }
+
+        if (record_count > 0)
+        {
+            // Versions in write order, the last write of an id wins
+            std::unordered_map<int, BlogVersion> versions;
+            BlogVersion collection = base->collection;
+            for (int id : touched)
+            {
+                collection = {next_version++, std::time(nullptr)};
+                versions[id] = collection;
+            }
+
+            TRACE_SHARED_SPAN("write_publish", traced);
+
+            // The next snapshot shares every chunk the batch did not touch, touched ones are copied once
+            std::unordered_map<size_t, BlogSnapshot::chunk> copies;
+            auto copy_of = [&](size_t c) -> BlogSnapshot::chunk &
+            {
+                auto it = copies.find(c);
+                if (it == copies.end())
+                    it = copies.emplace(c, *base->chunks[c]).first;
+                return it->second;
+            };
+
+            std::vector<BlogEntry> created;
+            for (const auto &[id, state] : staged)
+            {
+                if (!base->find_entry(id))
+                {
+                    if (state)
+                        created.push_back({std::make_shared<const Blog>(*state), versions.at(id)});
+                    continue;
+                }
+                // A repeated id may span two chunks, every copy of it is replaced
+                for (size_t c = base->chunk_not_below(id); c < base->chunks.size() && BlogSnapshot::id_of(base->chunks[c]->front()) <= id; c++)
+                {
+                    for (auto &entry : copy_of(c))
+                    {
+                        if (BlogSnapshot::id_of(entry) != id)
+                            continue;
+                        if (state)
+                            entry = {std::make_shared<const Blog>(*state), versions.at(id)};
+                        else
+                            entry.blog = nullptr;
+                    }
+                }
+            }
+            for (auto &[c, entries] : copies)
+            {
+                entries.erase(std::remove_if(entries.begin(), entries.end(), [](const BlogEntry &entry)
+                                             { return !entry.blog; }),
+                              entries.end());
+            }
+
+            // New ids are higher than every existing one, so appending keeps the listing sorted.
+            // They fill up the last chunk first, then go into new ones.
+            std::sort(created.begin(), created.end(), [](const BlogEntry &a, const BlogEntry &b)
+                      { return BlogSnapshot::id_of(a) < BlogSnapshot::id_of(b); });
+            size_t next_created = 0;
+            if (!created.empty() && !base->chunks.empty())
+            {
+                auto &last = copy_of(base->chunks.size() - 1);
+                while (next_created < created.size() && last.size() < BlogSnapshot::CHUNK_SIZE)
+                    last.push_back(std::move(created[next_created++]));
+            }
+
+            auto next = std::make_shared<BlogSnapshot>();
+            next->loaded_at = base->loaded_at;
+            next->collection = collection;
+            next->entry_count = base->entry_count;
+            next->chunks.reserve(base->chunks.size() + (created.size() - next_created) / BlogSnapshot::CHUNK_SIZE + 1);
+            for (size_t c = 0; c < base->chunks.size(); c++)
+            {
+                auto copy = copies.find(c);
+                if (copy == copies.end())
+                {
+                    next->chunks.push_back(base->chunks[c]);
+                    continue;
+                }
+                next->entry_count = next->entry_count - base->chunks[c]->size() + copy->second.size();
+                if (!copy->second.empty())
+                    next->chunks.push_back(std::make_shared<const BlogSnapshot::chunk>(std::move(copy->second)));
+            }
+            while (next_created < created.size())
+            {
+                size_t take = std::min(BlogSnapshot::CHUNK_SIZE, created.size() - next_created);
+                auto begin = std::make_move_iterator(created.begin() + next_created);
+                next->chunks.push_back(std::make_shared<const BlogSnapshot::chunk>(begin, begin + take));
+                next->entry_count += take;
+                next_created += take;
+            }
+
+            // The index may run ahead of the published snapshot, search results are looked up in it
+            std::vector<SearchIndex::change> changes;
+            changes.reserve(staged.size());
+            for (const auto &[id, state] : staged)
+            {
+                auto before = base->find_entry(id);
+                changes.push_back({before ? before->blog.get() : nullptr, state ? &*state : nullptr});
+            }
+            {
+                TRACE_SHARED_SPAN("search_index_apply", traced);
+                search_index.apply(changes);
+            }
+
+            size_t live_count = next->entry_count;
+            publish(std::move(next));
+            log_publish_lock.unlock();
+            log.maybe_compact(live_count);
+        }
+
+        for (size_t i = 0; i < batch.size(); i++)
+            batch[i].done.set_value(std::move(results[i]));
+    }
+
+public:
+    BlogRepository() : writer(&BlogRepository::writer_loop, this) {}
+
+    ~BlogRepository()
+    {
+        {
+            std::lock_guard lock(queue_mutex);
+            stopping = true;
+        }
+        queue_cv.notify_all();
+        writer.join();
+        log.close();
+    }
+
+    BlogRepository(const BlogRepository &) = delete;
+    BlogRepository &operator=(const BlogRepository &) = delete;
+
+    void load(const std::string &path, snapshot_format format = snapshot_format::text)
+    {
+        auto loaded = log.open(
+            path, [this]
+            { std::lock_guard lock(log_publish_mutex);
+              return get_all(); },
+            format);
+
+        std::stable_sort(loaded.begin(), loaded.end(), [](const Blog &a, const Blog &b)
+                         { return a.get_id() < b.get_id(); });
+
+        // Versions restart at load, loaded_at keeps the ETags of different runs apart
+        auto snapshot = std::make_shared<BlogSnapshot>();
+        snapshot->loaded_at = std::time(nullptr);
+        next_version = 1;
+        BlogVersion initial{next_version++, snapshot->loaded_at};
+        std::vector<BlogEntry> entries;
+        entries.reserve(loaded.size());
+        for (auto &blog : loaded)
+        {
+            entries.push_back({std::make_shared<const Blog>(std::move(blog)), initial});
+        }
+        search_index.build(entries);
+        for (size_t first = 0; first < entries.size(); first += BlogSnapshot::CHUNK_SIZE)
+        {
+            auto begin = std::make_move_iterator(entries.begin() + first);
+            size_t take = std::min(BlogSnapshot::CHUNK_SIZE, entries.size() - first);
+            snapshot->chunks.push_back(std::make_shared<const BlogSnapshot::chunk>(begin, begin + take));
+        }
+        snapshot->entry_count = entries.size();
+        snapshot->collection = initial;
+        publish(std::move(snapshot));
+    }
+
+    BlogLog &get_log() { return log; }
+
+    // The current version of the collection, for reads that must agree with each other
+    std::shared_ptr<const BlogSnapshot> snapshot() const
+    {
+        return current();
+    }
+
+    std::vector<Blog> get_all() const
+    {
+        return current()->get_all();
+    }
+
+    BlogPage get_page(int after_id, size_t limit) const
+    {
+        return current()->get_page(after_id, limit);
+    }
+
+    std::time_t get_loaded_at() const
+    {
+        return current()->loaded_at;
+    }
+
+    size_t size() const
+    {
+        return current()->size();
+    }
+
+    std::optional<Blog> find(int id) const
+    {
+        return current()->find(id);
+    }
+
+    const SearchIndex &get_search_index() const { return search_index; }
+
+    // Queues writes for the writer thread, the future completes once they are durable and visible.
+    // With all_or_nothing the writes are applied atomically: if any update or delete misses
+    // (its result has found == false) nothing was applied.
+    std::future<std::vector<BlogWriteResult>> submit(std::vector<BlogWrite> writes, bool all_or_nothing = false)
+    {
+        BlogWriteGroup group{std::move(writes), all_or_nothing, {}, tracing::current_request()};
+        auto future = group.done.get_future();
+        {
+            std::lock_guard lock(queue_mutex);
+            queue.push_back(std::move(group));
+        }
+        queue_cv.notify_one();
+        return future;
+    }
+
+    Blog create(const std::string &title, const std::string &content, const std::string &preview_content, const std::string &created_at)
+    {
+        TRACE_SPAN("write_queue");
+        return *submit({{BlogWrite::kind::create, 0, title, content, preview_content, created_at}}).get()[0].blog;
+    }
+
+    std::optional<Blog> update(int id, const std::string &title, const std::string &content, const std::string &preview_content)
+    {
+        TRACE_SPAN("write_queue");
+        return submit({{BlogWrite::kind::update, id, title, content, preview_content, ""}}).get()[0].blog;
+    }
+
+    bool remove(int id)
+    {
+        TRACE_SPAN("write_queue");
+        return submit({{BlogWrite::kind::remove, id, "", "", "", ""}}).get()[0].found;
+    }
+};
+
+// Process-wide repository shared by all controllers
+BlogRepository &blog_repository()
+{
+    static BlogRepository repository;
+    return repository;
+}
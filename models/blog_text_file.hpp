@@ -0,0 +1,215 @@
+#pragma once
+#include "models.hpp"
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Reader for the pipe-delimited text snapshot (blogs.db): a Blog::TEXT_FILE_HEADER line, then one
+// Blog::to_string_for_file per line. Files without the header predate field escaping, see is_legacy().
+//
+// The file is mapped and cut into newline-aligned chunks that are parsed in parallel. Fields are
+// split in place and decoded straight into the Blog they end up in. Chunks are joined in file
+// order and their errors logged in that order too, so the result does not depend on the threads.
+class BlogTextFile
+{
+    // Below this a chunk is not worth a thread
+    static constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+    int fd = -1;
+    const char *data = nullptr;
+    size_t size = 0;
+    size_t body_offset = 0;
+    unsigned threads_used = 0;
+
+    struct chunk_result
+    {
+        std::vector<Blog> blogs;
+        std::vector<std::string> errors;
+    };
+
+    // id|title|content|preview_content|created_at, created_at runs to the end of the line.
+    // Lines with fewer fields or an empty created_at are skipped, an unreadable id is reported.
+    static void parse_line(std::string_view line, std::string &scratch, chunk_result &result)
+    {
+        std::string_view fields[4];
+        size_t pos = 0;
+        for (auto &field : fields)
+        {
+            size_t bar = line.find('|', pos);
+            if (bar == std::string_view::npos)
+                return;
+            field = line.substr(pos, bar - pos);
+            pos = bar + 1;
+        }
+        std::string_view created_at = line.substr(pos);
+        if (created_at.empty())
+            return;
+
+        try
+        {
+            int id = std::stoi(std::string(fields[0]));
+
+            // Fields are escaped (%XX) on disk. Legacy files hold form values as they were posted,
+            // '+' already turned into spaces, so the same decode reads them as form input.
+            scratch.resize(fields[1].size() + fields[3].size() + created_at.size());
+            char *out = scratch.data();
+            size_t title_size = form_decoding::decode_into(fields[1], out, false);
+            size_t preview_size = form_decoding::decode_into(fields[3], out + title_size, false);
+            size_t created_at_size = form_decoding::decode_into(created_at, out + title_size + preview_size, false);
+            result.blogs.emplace_back(id, std::string_view(out, title_size), form_decoding::decode(fields[2], false),
+                                      std::string_view(out + title_size, preview_size),
+                                      std::string_view(out + title_size + preview_size, created_at_size));
+        }
+        catch (const std::exception &e)
+        {
+            result.errors.push_back("Error parsing line: " + std::string(line) + " - " + e.what());
+        }
+    }
+
+    chunk_result parse_chunk(size_t begin, size_t end) const
+    {
+        chunk_result result;
+        std::string scratch;
+        size_t pos = begin;
+        while (pos < end)
+        {
+            const void *newline = std::memchr(data + pos, '\n', end - pos);
+            size_t line_end = newline ? static_cast<const char *>(newline) - data : end;
+            if (line_end > pos)
+                parse_line(std::string_view(data + pos, line_end - pos), scratch, result);
+            pos = line_end + 1;
+        }
+        return result;
+    }
+
+public:
+    BlogTextFile() = default;
+    BlogTextFile(const BlogTextFile &) = delete;
+    BlogTextFile &operator=(const BlogTextFile &) = delete;
+
+    ~BlogTextFile()
+    {
+        close();
+    }
+
+    // Maps the file, returns false if it does not exist
+    bool open(const std::string &path)
+    {
+        close();
+
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+        {
+            close();
+            throw std::runtime_error("Cannot stat " + path);
+        }
+        size = static_cast<size_t>(st.st_size);
+        if (size == 0)
+            return true;
+
+        void *mapped = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close();
+            throw std::runtime_error("Cannot mmap " + path);
+        }
+        ::madvise(mapped, size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(mapped);
+
+        std::string_view header = Blog::TEXT_FILE_HEADER;
+        if (size > header.size() && std::string_view(data, header.size()) == header && data[header.size()] == '\n')
+            body_offset = header.size() + 1;
+        return true;
+    }
+
+    void close()
+    {
+        if (data)
+            ::munmap(const_cast<char *>(data), size);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+        data = nullptr;
+        size = 0;
+        body_offset = 0;
+    }
+
+    size_t file_size() const { return size; }
+
+    // True for a non-empty file without the header: written before fields were escaped, its
+    // values are decoded as form input and should be rewritten so that happens only once
+    bool is_legacy() const { return data && body_offset == 0; }
+
+    // Threads the last load_all() ran on
+    unsigned get_threads_used() const { return threads_used; }
+
+    // All blogs in file order. threads = 0 uses one per core, fewer when the file is small.
+    std::vector<Blog> load_all(unsigned threads = 0)
+    {
+        TRACE_SPAN("BlogTextFile::load_all");
+        if (!data)
+        {
+            threads_used = 0;
+            return {};
+        }
+
+        if (threads == 0)
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        size_t body_size = size - body_offset;
+        threads = static_cast<unsigned>(std::min<size_t>(threads, std::max<size_t>(1, body_size / MIN_CHUNK_BYTES)));
+        threads_used = threads;
+
+        // Chunk i starts on the line after offset body_size * i / threads of the body
+        std::vector<size_t> starts{body_offset};
+        for (unsigned i = 1; i < threads; i++)
+        {
+            size_t pos = std::max(body_offset + body_size / threads * i, starts.back());
+            const void *newline = pos < size ? std::memchr(data + pos, '\n', size - pos) : nullptr;
+            starts.push_back(newline ? static_cast<const char *>(newline) - data + 1 : size);
+        }
+        starts.push_back(size);
+
+        std::vector<std::future<chunk_result>> pending;
+        for (unsigned i = 1; i < threads; i++)
+        {
+            pending.push_back(std::async(std::launch::async, &BlogTextFile::parse_chunk, this, starts[i], starts[i + 1]));
+        }
+        std::vector<chunk_result> chunks;
+        chunks.reserve(threads);
+        chunks.push_back(parse_chunk(starts[0], starts[1]));
+        for (auto &chunk : pending)
+        {
+            chunks.push_back(chunk.get());
+        }
+
+        size_t total = 0;
+        for (const auto &chunk : chunks)
+        {
+            total += chunk.blogs.size();
+        }
+        std::vector<Blog> blogs;
+        blogs.reserve(total);
+        for (auto &chunk : chunks)
+        {
+            for (const auto &error : chunk.errors)
+            {
+                hh_web::logger::error(error);
+            }
+            std::move(chunk.blogs.begin(), chunk.blogs.end(), std::back_inserter(blogs));
+        }
+        return blogs;
+    }
+};
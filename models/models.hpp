@@ -1,98 +1,103 @@
 
 #pragma once
 #include "../library/web-lib.hpp"
+#include "../utils/tracing.hpp"
+#include "../utils/form_decoder.hpp"
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 
+// A blog post. The listing fields (title, preview_content, created_at) sit back to back in one
+// buffer and the content in another, so listings never touch the content. Both buffers are
+// immutable and shared, copying a Blog only bumps two reference counts.
 class Blog
 {
-    static int id_counter;
+    static std::atomic<int> id_counter;
     int id;
-    std::string title;
-    std::string content;
-    std::string preview_content;
-    std::string created_at;
+    uint32_t title_size = 0;
+    uint32_t preview_content_size = 0;
+    std::shared_ptr<const std::string> listing;
+    std::shared_ptr<const std::string> content;
+
+    void set_listing(std::string_view title, std::string_view preview_content, std::string_view created_at)
+    {
+        auto buffer = std::make_shared<std::string>();
+        buffer->reserve(title.size() + preview_content.size() + created_at.size());
+        buffer->append(title).append(preview_content).append(created_at);
+        title_size = static_cast<uint32_t>(title.size());
+        preview_content_size = static_cast<uint32_t>(preview_content.size());
+        listing = std::move(buffer);
+    }
 
 public:
     // Constructor for new blogs (auto-assigns ID)
-    Blog(std::string title, std::string content, std::string preview_content, std::string created_at)
-        : title(title), content(content), preview_content(preview_content), created_at(created_at)
+    Blog(std::string_view title, std::string content, std::string_view preview_content, std::string_view created_at)
+        : content(std::make_shared<const std::string>(std::move(content)))
     {
+        set_listing(title, preview_content, created_at);
         id = ++id_counter;
     }
 
     // Constructor for loading existing blogs from file (with specific ID)
-    Blog(int id, std::string title, std::string content, std::string preview_content, std::string created_at)
-        : id(id), title(title), content(content), preview_content(preview_content), created_at(created_at)
+    Blog(int id, std::string_view title, std::string content, std::string_view preview_content, std::string_view created_at)
+        : id(id), content(std::make_shared<const std::string>(std::move(content)))
     {
-        // Update counter if this ID is higher
-        if (id > id_counter)
+        set_listing(title, preview_content, created_at);
+        // Update counter if this ID is higher, blogs may be loaded on several threads
+        int seen = id_counter.load();
+        while (id > seen && !id_counter.compare_exchange_weak(seen, id))
         {
-            id_counter = id;
         }
     }
 
     int get_id() const { return id; }
-    std::string get_title() const { return title; }
-    std::string get_content() const { return content; }
-    std::string get_preview_content() const { return preview_content; }
-    std::string get_created_at() const { return created_at; }
+    std::string_view get_title() const { return std::string_view(*listing).substr(0, title_size); }
+    std::string_view get_content() const { return *content; }
+    std::string_view get_preview_content() const { return std::string_view(*listing).substr(title_size, preview_content_size); }
+    std::string_view get_created_at() const { return std::string_view(*listing).substr(title_size + preview_content_size); }
 
-    void set_title(const std::string &new_title) { title = new_title; }
-    void set_content(const std::string &new_content) { content = new_content; }
-    void set_preview_content(const std::string &new_preview_content) { preview_content = new_preview_content; }
-    void set_created_at(const std::string &new_created_at) { created_at = new_created_at; }
+    // Setters build new buffers, copies of this blog keep the old ones
+    void set_title(std::string_view new_title) { set_listing(new_title, get_preview_content(), get_created_at()); }
+    void set_content(std::string new_content) { content = std::make_shared<const std::string>(std::move(new_content)); }
+    void set_preview_content(std::string_view new_preview_content) { set_listing(get_title(), new_preview_content, get_created_at()); }
+    void set_created_at(std::string_view new_created_at) { set_listing(get_title(), get_preview_content(), new_created_at); }
+
+    // First line of a text file whose fields are escaped, files without it are legacy
+    static constexpr std::string_view TEXT_FILE_HEADER = "#blogs-text 2";
+
+    // Fields are stored decoded, so the delimiters they may contain are percent-escaped on disk
+    static std::string escape_field(std::string_view field)
+    {
+        return form_decoding::encode(field, "|\r\n");
+    }
 
     std::string to_string_for_file() const
     {
-        return std::to_string(id) + "|" + title + "|" + content + "|" + preview_content + "|" + created_at;
+        return std::to_string(id) + "|" + escape_field(get_title()) + "|" + escape_field(get_content()) + "|" +
+               escape_field(get_preview_content()) + "|" + escape_field(get_created_at());
     }
 
-    static std::vector<Blog> get_blogs_from_file(const std::string &file_path)
+    static void save_blogs_to_file(const std::string &file_path, const std::vector<Blog> &blogs)
     {
-        std::vector<Blog> blogs;
-        std::ifstream file(file_path);
-        if (!file.is_open())
+        std::ofstream file(file_path);
+        file << TEXT_FILE_HEADER << '\n';
+        for (const auto &blog : blogs)
         {
-            // File doesn't exist yet, return empty vector
-            return blogs;
+            file << blog.to_string_for_file() << '\n';
         }
-
-        std::string line;
-        while (std::getline(file, line))
+        file.close();
+        if (!file)
         {
-            if (line.empty())
-                continue; // Skip empty lines
-
-            std::istringstream iss(line);
-            std::string id_str, title, content, preview_content, created_at;
-
-            // Parse: id|title|content|preview_content|created_at
-            if (std::getline(iss, id_str, '|') &&
-                std::getline(iss, title, '|') &&
-                std::getline(iss, content, '|') &&
-                std::getline(iss, preview_content, '|') &&
-                std::getline(iss, created_at))
-            {
-                try
-                {
-                    int id = std::stoi(id_str);
-                    blogs.emplace_back(id, title, content, preview_content, created_at);
-                }
-                catch (const std::exception &e)
-                {
-                    hh_web::logger::error("Error parsing line: " + line + " - " + e.what());
-                    continue;
-                }
-            }
+            throw std::runtime_error("Cannot write blog file " + file_path);
         }
-        file.close();
-        return blogs;
     }
 };
 
 // Initialize static counter
-int Blog::id_counter = 0;
\ No newline at end of file
+std::atomic<int> Blog::id_counter{0};
\ No newline at end of file
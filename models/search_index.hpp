@@ -0,0 +1,584 @@
+#pragma once
+#include "models.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// A ranked search hit, score is BM25
+struct SearchHit
+{
+    int id;
+    float score;
+};
+
+// Inverted index over the title and content of every blog, ranked with BM25.
+//
+// Each indexed version of a blog gets a new document number, so posting lists only ever grow at
+// the end. An update indexes the blog again under a new number and marks the old one dead, a
+// delete only marks it dead; dead postings are skipped at query time and dropped, and the live
+// documents renumbered, once they outnumber the live ones.
+//
+// Postings are varint-coded (doc number delta, term frequency) pairs in blocks of BLOCK_SIZE.
+// Each block keeps its last doc number, so a cursor can jump over blocks it does not need, and
+// the largest length-normalized frequency ("impact") in it, which bounds the score any of its
+// documents can get. Queries are document-at-a-time with MaxScore: once the top-k is full,
+// terms that cannot lift a document into it alone are only probed, and blocks whose bounds add
+// up to less than the k-th score are skipped without being decoded.
+//
+// Writes come from the repository's writer thread, queries from any thread (shared lock).
+class SearchIndex
+{
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+    static constexpr size_t MAX_TOKEN_LENGTH = 64;
+    static constexpr size_t MAX_QUERY_TERMS = 16;
+    static constexpr uint32_t TITLE_WEIGHT = 2; // a title occurrence counts as this many
+    static constexpr float K1 = 1.2f;
+    static constexpr float B = 0.75f;
+
+private:
+    // Impacts are tf / (tf + K1 * (1 - B + B * length / average)) for the average length of when
+    // they were computed. For a larger average a document's impact grows at most by the ratio of
+    // the averages, which impact_bound accounts for, so an impact stays a bound as documents come and go.
+    struct block
+    {
+        uint32_t last_doc = 0;
+        uint32_t offset = 0; // into posting_list::data
+        float max_impact = 0;
+        float average = 1;
+    };
+
+    struct posting_list
+    {
+        std::vector<uint8_t> data;
+        std::vector<block> blocks;
+        uint32_t count = 0;   // postings, dead ones included
+        uint32_t live_df = 0; // live documents containing the term
+        float max_impact = 0; // over every block
+        float min_average = 0;
+    };
+
+    struct document
+    {
+        int id;
+        uint32_t length;
+        bool live;
+    };
+
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, posting_list> terms;
+    std::vector<document> documents;            // by document number
+    std::unordered_map<int, uint32_t> by_id;    // blog id -> live document number
+    uint64_t live_length = 0;                   // sum of the live documents' lengths
+    size_t dead_count = 0;
+
+    static void put_varint(std::vector<uint8_t> &out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    static uint32_t get_varint(const uint8_t *&p)
+    {
+        uint32_t value = *p & 0x7F;
+        int shift = 7;
+        while (*p++ & 0x80)
+        {
+            value |= static_cast<uint32_t>(*p & 0x7F) << shift;
+            shift += 7;
+        }
+        return value;
+    }
+
+    // Term -> weighted frequency for one blog, and the document length
+    static uint32_t count_terms(const Blog &blog, std::unordered_map<std::string, uint32_t> &counts)
+    {
+        uint32_t length = 0;
+        auto add = [&](std::string_view token, uint32_t weight)
+        {
+            counts[std::string(token)] += weight;
+            length += weight;
+        };
+        for_each_token(blog.get_title(), [&](std::string_view token)
+                       { add(token, TITLE_WEIGHT); });
+        for_each_token(blog.get_content(), [&](std::string_view token)
+                       { add(token, 1); });
+        return length;
+    }
+
+    static float impact(uint32_t frequency, uint32_t length, float average)
+    {
+        float tf = static_cast<float>(frequency);
+        return tf / (tf + K1 * (1 - B + B * static_cast<float>(length) / average));
+    }
+
+    static float impact_bound(float max_impact, float impact_average, float average)
+    {
+        return average > impact_average ? max_impact * (average / impact_average) : max_impact;
+    }
+
+    float average_length() const
+    {
+        return by_id.empty() ? 1.0f : std::max(1.0f, static_cast<float>(live_length) / static_cast<float>(by_id.size()));
+    }
+
+    static void append_posting(posting_list &list, uint32_t doc, uint32_t frequency, uint32_t length, float average)
+    {
+        if (list.count % BLOCK_SIZE == 0)
+        {
+            block next;
+            next.last_doc = list.blocks.empty() ? 0 : list.blocks.back().last_doc;
+            next.offset = static_cast<uint32_t>(list.data.size());
+            next.average = average;
+            list.blocks.push_back(next);
+            list.min_average = list.blocks.size() == 1 ? average : std::min(list.min_average, average);
+        }
+        block &current = list.blocks.back();
+        put_varint(list.data, doc - current.last_doc);
+        put_varint(list.data, frequency);
+        current.last_doc = doc;
+        current.max_impact = std::max(current.max_impact, impact(frequency, length, current.average));
+        list.max_impact = std::max(list.max_impact, current.max_impact);
+        list.count++;
+    }
+
+    // Calls f(doc, frequency) for every posting of list, dead ones included
+    template <typename F>
+    static void for_each_posting(const posting_list &list, F &&f)
+    {
+        for (size_t b = 0; b < list.blocks.size(); b++)
+        {
+            const uint8_t *p = list.data.data() + list.blocks[b].offset;
+            uint32_t doc = b == 0 ? 0 : list.blocks[b - 1].last_doc;
+            size_t in_block = std::min<size_t>(BLOCK_SIZE, list.count - b * BLOCK_SIZE);
+            for (size_t i = 0; i < in_block; i++)
+            {
+                doc += get_varint(p);
+                uint32_t frequency = get_varint(p);
+                f(doc, frequency);
+            }
+        }
+    }
+
+    // Caller holds the lock exclusively
+    void add_locked(const Blog &blog)
+    {
+        std::unordered_map<std::string, uint32_t> counts;
+        uint32_t length = count_terms(blog, counts);
+        uint32_t doc = static_cast<uint32_t>(documents.size());
+        documents.push_back({blog.get_id(), length, true});
+        by_id[blog.get_id()] = doc;
+        live_length += length;
+
+        float average = average_length();
+        for (const auto &[term, frequency] : counts)
+        {
+            posting_list &list = terms[term];
+            append_posting(list, doc, frequency, length, average);
+            list.live_df++;
+        }
+    }
+
+    void remove_locked(const Blog &blog)
+    {
+        auto it = by_id.find(blog.get_id());
+        if (it == by_id.end())
+            return;
+        document &doc = documents[it->second];
+        doc.live = false;
+        live_length -= doc.length;
+        dead_count++;
+        by_id.erase(it);
+
+        std::unordered_map<std::string, uint32_t> counts;
+        count_terms(blog, counts);
+        for (const auto &[term, frequency] : counts)
+        {
+            auto list = terms.find(term);
+            if (list != terms.end() && list->second.live_df > 0)
+                list->second.live_df--;
+        }
+    }
+
+    // Re-encodes every list without its dead postings and with impacts for the current average.
+    // Live documents are renumbered densely in their old order, so dead ones free their slot too.
+    void rebuild_lists_locked()
+    {
+        std::vector<uint32_t> renumbered(documents.size(), UINT32_MAX);
+        std::vector<document> live_documents;
+        live_documents.reserve(by_id.size());
+        for (uint32_t doc = 0; doc < documents.size(); doc++)
+        {
+            if (!documents[doc].live)
+                continue;
+            renumbered[doc] = static_cast<uint32_t>(live_documents.size());
+            by_id[documents[doc].id] = renumbered[doc];
+            live_documents.push_back(documents[doc]);
+        }
+
+        float average = average_length();
+        for (auto it = terms.begin(); it != terms.end();)
+        {
+            posting_list rebuilt;
+            for_each_posting(it->second, [&](uint32_t doc, uint32_t frequency)
+                             {
+                                 if (documents[doc].live)
+                                     append_posting(rebuilt, renumbered[doc], frequency, documents[doc].length, average); });
+            rebuilt.live_df = rebuilt.count;
+            if (rebuilt.count == 0)
+                it = terms.erase(it);
+            else
+            {
+                rebuilt.data.shrink_to_fit();
+                it->second = std::move(rebuilt);
+                ++it;
+            }
+        }
+        documents = std::move(live_documents);
+        dead_count = 0;
+    }
+
+    // Position in one posting list during a query. Entering a block only reads its header: until the
+    // block is decoded (whole, on first use) doc is a lower bound, the doc after the previous block.
+    struct cursor
+    {
+        const posting_list *list;
+        float weight;    // idf * (K1 + 1), a posting scores weight * impact
+        float average;   // of the query, for the impact bounds
+        float max_score; // bound for any document of the list
+        float block_score = 0; // bound for any document of the current block
+        size_t block_index = 0;
+        size_t position = 0; // in the decoded block
+        size_t block_count = 0;
+        uint32_t doc = 0;
+        uint32_t frequency = 0;
+        bool decoded = false;
+        bool done = false;
+        uint32_t docs[BLOCK_SIZE];
+        uint32_t frequencies[BLOCK_SIZE];
+
+        void enter_block(size_t index)
+        {
+            block_index = index;
+            if (index >= list->blocks.size())
+            {
+                done = true;
+                return;
+            }
+            decoded = false;
+            doc = index == 0 ? 0 : list->blocks[index - 1].last_doc + 1;
+            const block &b = list->blocks[index];
+            block_score = weight * impact_bound(b.max_impact, b.average, average);
+        }
+
+        void decode()
+        {
+            const uint8_t *p = list->data.data() + list->blocks[block_index].offset;
+            uint32_t last = block_index == 0 ? 0 : list->blocks[block_index - 1].last_doc;
+            block_count = std::min<size_t>(BLOCK_SIZE, list->count - block_index * BLOCK_SIZE);
+            for (size_t i = 0; i < block_count; i++)
+            {
+                last += get_varint(p);
+                docs[i] = last;
+                frequencies[i] = get_varint(p);
+            }
+            decoded = true;
+            position = 0;
+            doc = docs[0];
+            frequency = frequencies[0];
+        }
+
+        // Makes doc exact
+        void settle()
+        {
+            if (!done && !decoded)
+                decode();
+        }
+
+        void next()
+        {
+            if (++position == block_count)
+            {
+                enter_block(block_index + 1);
+                return;
+            }
+            doc = docs[position];
+            frequency = frequencies[position];
+        }
+
+        // Moves to the first posting with a doc number >= target, doc may be left a lower bound
+        void advance(uint32_t target)
+        {
+            if (done || doc >= target)
+                return;
+            if (list->blocks[block_index].last_doc < target)
+            {
+                size_t index = block_index + 1;
+                while (index < list->blocks.size() && list->blocks[index].last_doc < target)
+                    index++;
+                enter_block(index);
+            }
+            while (!done && doc < target)
+            {
+                if (decoded)
+                    next();
+                else
+                    decode();
+            }
+        }
+
+        uint32_t block_last_doc() const { return list->blocks[block_index].last_doc; }
+    };
+
+public:
+    // Calls f with each case-folded token of text. Tokens are runs of ASCII letters and digits
+    // or of non-ASCII bytes (UTF-8 text stays whole), longer ones are cut at MAX_TOKEN_LENGTH.
+    template <typename F>
+    static void for_each_token(std::string_view text, F &&f)
+    {
+        char token[MAX_TOKEN_LENGTH];
+        size_t length = 0;
+        for (size_t i = 0; i <= text.size(); i++)
+        {
+            unsigned char c = i < text.size() ? static_cast<unsigned char>(text[i]) : ' ';
+            bool word = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+            if (word)
+            {
+                if (length < MAX_TOKEN_LENGTH)
+                    token[length++] = (c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : static_cast<char>(c);
+            }
+            else if (length > 0)
+            {
+                f(std::string_view(token, length));
+                length = 0;
+            }
+        }
+    }
+
+    // Replaces the whole index
+    template <typename Entries>
+    void build(const Entries &entries)
+    {
+        std::unique_lock lock(mutex);
+        terms.clear();
+        documents.clear();
+        by_id.clear();
+        live_length = 0;
+        dead_count = 0;
+        documents.reserve(entries.size());
+        for (const auto &entry : entries)
+        {
+            remove_locked(*entry.blog); // an id repeated in the file, the last one wins
+            add_locked(*entry.blog);
+        }
+        rebuild_lists_locked(); // impacts were computed while the average was still moving
+    }
+
+    // One write: before is the blog as it was (nullptr when created), after as it is now (nullptr when deleted)
+    struct change
+    {
+        const Blog *before;
+        const Blog *after;
+    };
+
+    void apply(const std::vector<change> &changes)
+    {
+        std::unique_lock lock(mutex);
+        for (const auto &c : changes)
+        {
+            if (c.before)
+                remove_locked(*c.before);
+            if (c.after)
+                add_locked(*c.after);
+        }
+        if (dead_count > 1024 && dead_count > by_id.size())
+            rebuild_lists_locked();
+    }
+
+    // Best limit hits for query, highest score first
+    std::vector<SearchHit> search(std::string_view query, size_t limit) const
+    {
+        TRACE_SPAN("search_index");
+        std::vector<std::string> words;
+        for_each_token(query, [&](std::string_view token)
+                       {
+                           if (words.size() < MAX_QUERY_TERMS && std::find(words.begin(), words.end(), token) == words.end())
+                               words.emplace_back(token); });
+
+        std::shared_lock lock(mutex);
+        std::vector<SearchHit> hits;
+        size_t live = by_id.size();
+        if (limit == 0 || live == 0)
+            return hits;
+        float average = average_length();
+
+        std::vector<cursor> cursors;
+        for (const auto &word : words)
+        {
+            auto it = terms.find(word);
+            if (it == terms.end() || it->second.live_df == 0)
+                continue;
+            const posting_list &list = it->second;
+            float df = static_cast<float>(list.live_df);
+            float idf = std::log(1.0f + (static_cast<float>(live) - df + 0.5f) / (df + 0.5f));
+            float weight = idf * (K1 + 1);
+            cursors.emplace_back();
+            cursor &c = cursors.back();
+            c.list = &list;
+            c.weight = weight;
+            c.average = average;
+            c.max_score = weight * impact_bound(list.max_impact, list.min_average, average);
+            c.enter_block(0);
+        }
+        if (cursors.empty())
+            return hits;
+
+        // Cheapest terms first. bound_below[i] is what terms 0..i-1 can add together.
+        std::sort(cursors.begin(), cursors.end(), [](const cursor &a, const cursor &b)
+                  { return a.max_score < b.max_score; });
+        std::vector<float> bound_below(cursors.size() + 1, 0);
+        for (size_t i = 0; i < cursors.size(); i++)
+            bound_below[i + 1] = bound_below[i] + cursors[i].max_score;
+
+        // Min-heap of the best limit hits so far. On equal scores the older document ranks higher,
+        // so the newest is evicted first and a newcomer must score strictly above the threshold.
+        using scored = std::pair<float, uint32_t>; // (score, UINT32_MAX - doc)
+        std::priority_queue<scored, std::vector<scored>, std::greater<scored>> top;
+        float threshold = 0;
+        size_t first_essential = 0; // terms before it cannot reach the top alone
+        uint32_t checked_until = 0; // the blocks up to here were checked against checked_threshold
+        float checked_threshold = -1;
+
+        while (true)
+        {
+            uint32_t candidate = UINT32_MAX;
+            for (size_t i = first_essential; i < cursors.size(); i++)
+            {
+                if (!cursors[i].done)
+                    candidate = std::min(candidate, cursors[i].doc);
+            }
+            if (candidate == UINT32_MAX)
+                break;
+
+            // Skip ahead while the current blocks together cannot beat the threshold
+            if (top.size() == limit && (candidate > checked_until || threshold != checked_threshold))
+            {
+                float block_bound = bound_below[first_essential];
+                uint32_t blocks_end = UINT32_MAX;
+                for (size_t i = first_essential; i < cursors.size(); i++)
+                {
+                    if (cursors[i].done)
+                        continue;
+                    block_bound += cursors[i].block_score;
+                    blocks_end = std::min(blocks_end, cursors[i].block_last_doc());
+                }
+                if (block_bound <= threshold)
+                {
+                    for (size_t i = first_essential; i < cursors.size(); i++)
+                        cursors[i].advance(blocks_end + 1);
+                    continue;
+                }
+                checked_until = blocks_end;
+                checked_threshold = threshold;
+            }
+
+            // Candidate may be a lower bound only, decode the blocks it came from and look again
+            bool moved = false;
+            for (size_t i = first_essential; i < cursors.size(); i++)
+            {
+                cursor &c = cursors[i];
+                if (!c.done && c.doc == candidate && !c.decoded)
+                {
+                    c.decode();
+                    moved |= c.doc != candidate;
+                }
+            }
+            if (moved)
+                continue;
+
+            const document &doc = documents[candidate];
+            float length_norm = K1 * (1 - B + B * static_cast<float>(doc.length) / average);
+            auto score_of = [&](const cursor &c)
+            {
+                float tf = static_cast<float>(c.frequency);
+                return c.weight * tf / (tf + length_norm);
+            };
+
+            float score = 0;
+            for (size_t i = first_essential; i < cursors.size(); i++)
+            {
+                cursor &c = cursors[i];
+                if (!c.done && c.doc == candidate)
+                {
+                    score += score_of(c);
+                    c.next();
+                }
+            }
+            if (!doc.live)
+                continue;
+
+            for (size_t i = first_essential; i-- > 0;)
+            {
+                if (top.size() == limit && score + bound_below[i + 1] <= threshold)
+                    break;
+                cursor &c = cursors[i];
+                c.advance(candidate);
+                c.settle();
+                if (!c.done && c.doc == candidate)
+                    score += score_of(c);
+            }
+
+            if (top.size() < limit)
+                top.push({score, UINT32_MAX - candidate});
+            else if (score > threshold)
+            {
+                top.pop();
+                top.push({score, UINT32_MAX - candidate});
+            }
+            if (top.size() == limit)
+            {
+                threshold = top.top().first;
+                while (first_essential < cursors.size() && bound_below[first_essential + 1] <= threshold)
+                    first_essential++;
+            }
+        }
+
+        hits.resize(top.size());
+        for (size_t i = hits.size(); i-- > 0;)
+        {
+            hits[i] = {documents[UINT32_MAX - top.top().second].id, top.top().first};
+            top.pop();
+        }
+        return hits;
+    }
+
+    size_t size() const
+    {
+        std::shared_lock lock(mutex);
+        return by_id.size();
+    }
+
+    // Approximate heap bytes held by the index
+    size_t memory_bytes() const
+    {
+        std::shared_lock lock(mutex);
+        size_t bytes = documents.capacity() * sizeof(document) + by_id.size() * (sizeof(std::pair<int, uint32_t>) + 2 * sizeof(void *)) +
+                       terms.bucket_count() * sizeof(void *);
+        for (const auto &[term, list] : terms)
+        {
+            bytes += sizeof(std::pair<const std::string, posting_list>) + 2 * sizeof(void *) + (term.size() > 15 ? term.capacity() + 1 : 0);
+            bytes += list.data.capacity() + list.blocks.capacity() * sizeof(block);
+        }
+        return bytes;
+    }
+};
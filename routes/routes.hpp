@@ -3,24 +3,28 @@
 #include "../library/web-lib.hpp"
 #include "../controllers/controllers.hpp"
 #include "../controllers/api_controllers.hpp"
+#include "../controllers/observability_controllers.hpp"
 #include "../middlewares/middlewares.hpp"
+#include "../utils/static_assets.hpp"
+#include "../utils/metrics.hpp"
 #include <memory>
 
 std::shared_ptr<hh_web::web_router<>> make_views_router()
 {
     auto router = std::make_shared<hh_web::web_router<>>();
+    InstrumentedRouter routes(router);
 
-    router->get("/", Route_V(index_controller));
-    router->get("/blogs/:id", Route_V(get_single_blog_controller));
-    router->get("/admin/login", Route_V(admin_login_controller));
-    router->get("/admin/dashboard", Route_V(admin_auth, admin_dashboard_controller));
-    router->get("/admin/blogs/:id/edit", Route_V(admin_auth, admin_edit_blog_controller));
+    routes.get("/", Traced_V(index_controller));
+    routes.get("/blogs/:id", Traced_V(get_single_blog_controller));
+    routes.get("/admin/login", Traced_V(admin_login_controller));
+    routes.get("/admin/dashboard", Traced_V(admin_auth, admin_dashboard_controller));
+    routes.get("/admin/blogs/:id/edit", Traced_V(admin_auth, admin_edit_blog_controller));
 
-    router->post("/admin/login", Route_V(admin_login_post_controller));
+    routes.post("/admin/login", Traced_V(admin_login_post_controller));
 
-    router->post("/admin/blogs/create", Route_V(admin_auth, check_body, create_blog_controller));
-    router->post("/admin/blogs/:id/edit", Route_V(admin_auth, check_body, update_blog_controller));
-    router->delete_("/admin/blogs/:id/delete", Route_V(admin_auth, delete_blog_controller));
+    routes.post("/admin/blogs/create", Traced_V(admin_auth, check_body, create_blog_controller));
+    routes.post("/admin/blogs/:id/edit", Traced_V(admin_auth, check_body, update_blog_controller));
+    routes.delete_("/admin/blogs/:id/delete", Traced_V(admin_auth, delete_blog_controller));
 
     return router;
 }
@@ -28,13 +32,35 @@ std::shared_ptr<hh_web::web_router<>> make_views_router()
 std::shared_ptr<hh_web::web_router<>> make_apis_router()
 {
     auto router = std::make_shared<hh_web::web_router<>>();
+    InstrumentedRouter routes(router);
 
-    router->get("/api/blogs", Route_V(api_get_all_blogs_controller));
-    router->get("/api/blogs/:id", Route_V(api_get_single_blog_controller));
+    routes.get("/api/blogs", Traced_V(api_get_all_blogs_controller));
+    routes.get("/api/blogs/:id", Traced_V(api_get_single_blog_controller));
+    routes.get("/api/search", Traced_V(api_search_controller));
 
-    router->post("/api/blogs", Route_V(api_auth_admin, check_body, api_create_blog_controller));
-    router->put("/api/blogs/:id", Route_V(api_auth_admin, check_body, api_update_blog_controller));
-    router->delete_("/api/blogs/:id", Route_V(api_auth_admin, api_delete_blog_controller));
+    routes.post("/api/blogs", Traced_V(api_auth_admin, check_body, api_create_blog_controller));
+    routes.post("/api/blogs/batch", Traced_V(api_auth_admin, check_body, api_batch_blogs_controller));
+    routes.put("/api/blogs/:id", Traced_V(api_auth_admin, check_body, api_update_blog_controller));
+    routes.delete_("/api/blogs/:id", Traced_V(api_auth_admin, api_delete_blog_controller));
+
+    routes.get("/metrics", Traced_V(metrics_controller));
+    routes.get("/debug/trace", Traced_V(api_auth_admin, trace_dump_controller));
+
+    return router;
+}
+
+
+// One GET route per file loaded by static_assets(), served from memory
+std::shared_ptr<hh_web::web_router<>> make_static_router()
+{
+    auto router = std::make_shared<hh_web::web_router<>>();
+    InstrumentedRouter routes(router);
+
+    for (const auto &[url, asset] : static_assets().get_assets())
+    {
+        routes.get(url, Route_V([asset = asset](std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+                                 { return send_static_asset(*asset, req, res); }));
+    }
 
     return router;
 }
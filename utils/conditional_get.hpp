@@ -0,0 +1,123 @@
+#pragma once
+#include "../library/web-lib.hpp"
+#include "../models/blog_repository.hpp"
+#include "../views/template_cache.hpp"
+#include <algorithm>
+#include <ctime>
+#include <string>
+
+// Validators of one representation: a strong ETag and its Last-Modified time
+struct Validators
+{
+    std::string etag;
+    std::time_t last_modified = 0;
+};
+
+// Start of every ETag: the representation kind and the load epoch. HTML is rendered from the
+// templates, so its tags also carry their generation and its times move when they change.
+std::string etag_prefix(const std::string &kind, std::time_t &last_modified)
+{
+    std::string prefix = kind + "-" + std::to_string(blog_repository().get_loaded_at());
+    if (kind == "html")
+    {
+        prefix += "-t" + std::to_string(template_cache().generation());
+        last_modified = std::max(last_modified, template_cache().get_changed_at());
+    }
+    return prefix;
+}
+
+// ETag of a single blog, kind tells apart representations of the same blog ("html", "json")
+Validators blog_validators(const std::string &kind, int id, const BlogVersion &version)
+{
+    std::time_t last_modified = version.modified_at;
+    std::string prefix = etag_prefix(kind, last_modified);
+    return {"\"" + prefix + "-" + std::to_string(id) + "-" + std::to_string(version.version) + "\"", last_modified};
+}
+
+// ETag of a listing, changes whenever any blog is created, updated or deleted
+Validators collection_validators(const std::string &kind, const BlogVersion &version)
+{
+    std::time_t last_modified = version.modified_at;
+    std::string prefix = etag_prefix(kind, last_modified);
+    return {"\"" + prefix + "-all-" + std::to_string(version.version) + "\"", last_modified};
+}
+
+std::string format_http_date(std::time_t time)
+{
+    std::tm tm{};
+    gmtime_r(&time, &tm);
+    char buffer[64];
+    std::strftime(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buffer;
+}
+
+bool parse_http_date(const std::string &value, std::time_t &time)
+{
+    std::tm tm{};
+    const char *end = strptime(value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (!end)
+        return false;
+    time = timegm(&tm);
+    return true;
+}
+
+// True if any entity tag in an If-None-Match list matches etag (weak comparison, as RFC 9110 asks for GET)
+bool etag_list_matches(const std::string &header, const std::string &etag)
+{
+    size_t pos = 0;
+    while (pos < header.size())
+    {
+        size_t comma = header.find(',', pos);
+        std::string tag = header.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? header.size() : comma + 1;
+
+        tag.erase(0, tag.find_first_not_of(" \t"));
+        tag.erase(tag.find_last_not_of(" \t") + 1);
+        if (tag.rfind("W/", 0) == 0)
+            tag.erase(0, 2);
+
+        if (tag == "*" || tag == etag)
+            return true;
+    }
+    return false;
+}
+
+// Whether the client's copy is still current. If-None-Match wins over If-Modified-Since when both are sent.
+bool is_not_modified(std::shared_ptr<hh_web::web_request> req, const Validators &validators)
+{
+    auto if_none_match = req->get_header("If-None-Match");
+    if (!if_none_match.empty())
+    {
+        for (const auto &header : if_none_match)
+        {
+            if (etag_list_matches(header, validators.etag))
+                return true;
+        }
+        return false;
+    }
+
+    for (const auto &header : req->get_header("If-Modified-Since"))
+    {
+        std::time_t since;
+        if (parse_http_date(header, since) && validators.last_modified <= since)
+            return true;
+    }
+    return false;
+}
+
+void set_validator_headers(std::shared_ptr<hh_web::web_response> res, const Validators &validators)
+{
+    res->set_header("ETag", validators.etag);
+    res->set_header("Last-Modified", format_http_date(validators.last_modified));
+}
+
+// Answers with 304 and no body if the client's copy is current, otherwise only sets the validator headers
+bool send_not_modified_if_current(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res, const Validators &validators)
+{
+    set_validator_headers(res, validators);
+    if (!is_not_modified(req, validators))
+        return false;
+
+    res->set_status(304, "Not Modified");
+    return true;
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace form_decoding
+{
+    // Value of a hex digit, -1 for anything else
+    struct hex_table
+    {
+        int8_t values[256];
+
+        constexpr hex_table() : values{}
+        {
+            for (int c = 0; c < 256; c++)
+                values[c] = -1;
+            for (int c = '0'; c <= '9'; c++)
+                values[c] = static_cast<int8_t>(c - '0');
+            for (int c = 'a'; c <= 'f'; c++)
+                values[c] = static_cast<int8_t>(c - 'a' + 10);
+            for (int c = 'A'; c <= 'F'; c++)
+                values[c] = static_cast<int8_t>(c - 'A' + 10);
+        }
+    };
+
+    constexpr hex_table hex{};
+
+    // Decodes %XX (and '+' to a space when plus_as_space) from in into out, which must hold
+    // in.size() bytes since decoding never grows the text. Malformed escapes are copied as they are.
+    // Returns the decoded length.
+    size_t decode_into(std::string_view in, char *out, bool plus_as_space)
+    {
+        const char *src = in.data();
+        size_t n = in.size();
+        size_t i = 0, o = 0;
+
+        while (i < n)
+        {
+#ifdef __SSE2__
+            // Copy 16 bytes at a time while none of them needs decoding
+            const __m128i percent = _mm_set1_epi8('%');
+            const __m128i plus = _mm_set1_epi8(plus_as_space ? '+' : '%');
+            while (i + 16 <= n)
+            {
+                __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, percent), _mm_cmpeq_epi8(block, plus)));
+                if (mask != 0)
+                {
+                    int plain = __builtin_ctz(static_cast<unsigned>(mask));
+                    std::memcpy(out + o, src + i, plain);
+                    i += plain;
+                    o += plain;
+                    break;
+                }
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(out + o), block);
+                i += 16;
+                o += 16;
+            }
+            if (i >= n)
+                break;
+#endif
+            char c = src[i];
+            if (c == '%' && i + 2 < n && hex.values[static_cast<unsigned char>(src[i + 1])] >= 0 &&
+                hex.values[static_cast<unsigned char>(src[i + 2])] >= 0)
+            {
+                out[o++] = static_cast<char>(hex.values[static_cast<unsigned char>(src[i + 1])] * 16 +
+                                             hex.values[static_cast<unsigned char>(src[i + 2])]);
+                i += 3;
+            }
+            else
+            {
+                out[o++] = (c == '+' && plus_as_space) ? ' ' : c;
+                i++;
+            }
+        }
+        return o;
+    }
+
+    std::string decode(std::string_view in, bool plus_as_space)
+    {
+        std::string out(in.size(), '\0');
+        out.resize(decode_into(in, out.data(), plus_as_space));
+        return out;
+    }
+
+    // Percent-encodes the bytes of reserved (and '%' itself), everything else is copied
+    std::string encode(std::string_view in, std::string_view reserved)
+    {
+        static const char digits[] = "0123456789ABCDEF";
+        std::string out;
+        out.reserve(in.size());
+        size_t run_start = 0;
+        for (size_t i = 0; i < in.size(); i++)
+        {
+            char c = in[i];
+            if (c != '%' && reserved.find(c) == std::string_view::npos)
+                continue;
+            out.append(in.data() + run_start, i - run_start);
+            out += '%';
+            out += digits[static_cast<unsigned char>(c) >> 4];
+            out += digits[static_cast<unsigned char>(c) & 0xF];
+            run_start = i + 1;
+        }
+        out.append(in.data() + run_start, in.size() - run_start);
+        return out;
+    }
+}
+
+// An application/x-www-form-urlencoded body, decoded once in a single pass.
+// Keys and values are decoded back to back into one buffer sized to the body, fields are views into it.
+class FormData
+{
+    std::unique_ptr<char[]> arena;
+    std::vector<std::pair<std::string_view, std::string_view>> fields;
+
+public:
+    FormData() = default;
+
+    explicit FormData(std::string_view body) : arena(new char[body.size() ? body.size() : 1])
+    {
+        char *out = arena.get();
+        size_t pos = 0;
+        while (pos < body.size())
+        {
+            const void *amp = std::memchr(body.data() + pos, '&', body.size() - pos);
+            size_t end = amp ? static_cast<const char *>(amp) - body.data() : body.size();
+            std::string_view pair = body.substr(pos, end - pos);
+            pos = end + 1;
+
+            // Pairs without '=' carry nothing we read
+            size_t equals = pair.find('=');
+            if (equals == std::string_view::npos)
+                continue;
+
+            size_t key_length = form_decoding::decode_into(pair.substr(0, equals), out, true);
+            std::string_view key(out, key_length);
+            out += key_length;
+            size_t value_length = form_decoding::decode_into(pair.substr(equals + 1), out, true);
+            std::string_view value(out, value_length);
+            out += value_length;
+            fields.emplace_back(key, value);
+        }
+    }
+
+    FormData(FormData &&) = default;
+    FormData &operator=(FormData &&) = default;
+    FormData(const FormData &) = delete;
+    FormData &operator=(const FormData &) = delete;
+
+    // Decoded value of key, empty when absent. A repeated key gives its last value.
+    std::string_view get(std::string_view key) const
+    {
+        for (auto it = fields.rbegin(); it != fields.rend(); ++it)
+        {
+            if (it->first == key)
+                return it->second;
+        }
+        return {};
+    }
+
+    bool contains(std::string_view key) const
+    {
+        for (const auto &field : fields)
+        {
+            if (field.first == key)
+                return true;
+        }
+        return false;
+    }
+
+    size_t size() const { return fields.size(); }
+    const std::vector<std::pair<std::string_view, std::string_view>> &get_fields() const { return fields; }
+};
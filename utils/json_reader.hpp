@@ -0,0 +1,425 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Forward-only reader over a JSON text, for request bodies whose shape we know.
+// Nothing is materialized beyond what is read: values can be skipped without being decoded.
+class JsonCursor
+{
+    std::string_view text;
+    size_t pos = 0;
+
+    static void append_utf8(std::string &out, uint32_t code)
+    {
+        if (code < 0x80)
+            out += static_cast<char>(code);
+        else if (code < 0x800)
+        {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool read_hex4(uint32_t &code)
+    {
+        if (pos + 4 > text.size())
+            return false;
+        code = 0;
+        for (int i = 0; i < 4; i++)
+        {
+            char c = text[pos++];
+            code <<= 4;
+            if (c >= '0' && c <= '9')
+                code |= static_cast<uint32_t>(c - '0');
+            else if (c >= 'a' && c <= 'f')
+                code |= static_cast<uint32_t>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F')
+                code |= static_cast<uint32_t>(c - 'A' + 10);
+            else
+                return false;
+        }
+        return true;
+    }
+
+    // First position at or after from holding '"', '\\' or a control character, text.size() when none
+    size_t scan_plain(size_t from) const
+    {
+        size_t i = from;
+#ifdef __SSE2__
+        const __m128i quote = _mm_set1_epi8('"');
+        const __m128i backslash = _mm_set1_epi8('\\');
+        const __m128i control_max = _mm_set1_epi8(0x1F);
+        while (i + 16 <= text.size())
+        {
+            __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text.data() + i));
+            __m128i special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, quote), _mm_cmpeq_epi8(block, backslash)),
+                                           _mm_cmpeq_epi8(_mm_max_epu8(block, control_max), control_max));
+            int mask = _mm_movemask_epi8(special);
+            if (mask != 0)
+                return i + __builtin_ctz(static_cast<unsigned>(mask));
+            i += 16;
+        }
+#endif
+        while (i < text.size() && text[i] != '"' && text[i] != '\\' && static_cast<unsigned char>(text[i]) >= 0x20)
+            i++;
+        return i;
+    }
+
+    bool skip_digits()
+    {
+        size_t start = pos;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9')
+            pos++;
+        return pos > start;
+    }
+
+    bool skip_literal(std::string_view literal)
+    {
+        if (text.substr(pos, literal.size()) != literal)
+            return false;
+        pos += literal.size();
+        return true;
+    }
+
+public:
+    explicit JsonCursor(std::string_view text) : text(text) {}
+
+    void skip_whitespace()
+    {
+        while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+            pos++;
+    }
+
+    // Next non-whitespace character without consuming it, '\0' at the end
+    char peek()
+    {
+        skip_whitespace();
+        return pos < text.size() ? text[pos] : '\0';
+    }
+
+    // Consumes c if it is the next non-whitespace character
+    bool consume(char c)
+    {
+        if (peek() != c)
+            return false;
+        pos++;
+        return true;
+    }
+
+    bool at_end()
+    {
+        return peek() == '\0';
+    }
+
+    bool read_string(std::string &out)
+    {
+        if (!consume('"'))
+            return false;
+        out.clear();
+        size_t run_start = pos;
+        while (pos < text.size())
+        {
+            pos = scan_plain(pos);
+            if (pos >= text.size())
+                return false;
+            char c = text[pos];
+            if (c == '"')
+            {
+                out.append(text.data() + run_start, pos - run_start);
+                pos++;
+                return true;
+            }
+            if (c != '\\')
+                return false;
+
+            out.append(text.data() + run_start, pos - run_start);
+            if (++pos >= text.size())
+                return false;
+            switch (text[pos++])
+            {
+            case '"':
+                out += '"';
+                break;
+            case '\\':
+                out += '\\';
+                break;
+            case '/':
+                out += '/';
+                break;
+            case 'b':
+                out += '\b';
+                break;
+            case 'f':
+                out += '\f';
+                break;
+            case 'n':
+                out += '\n';
+                break;
+            case 'r':
+                out += '\r';
+                break;
+            case 't':
+                out += '\t';
+                break;
+            case 'u':
+            {
+                uint32_t code;
+                if (!read_hex4(code))
+                    return false;
+                // Surrogate pair
+                if (code >= 0xD800 && code <= 0xDBFF && text.substr(pos, 2) == "\\u")
+                {
+                    pos += 2;
+                    uint32_t low;
+                    if (!read_hex4(low) || low < 0xDC00 || low > 0xDFFF)
+                        return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                append_utf8(out, code);
+                break;
+            }
+            default:
+                return false;
+            }
+            run_start = pos;
+        }
+        return false;
+    }
+
+    // Checks a string without decoding it, raw is what lies between the quotes
+    bool skip_string(std::string_view *raw = nullptr)
+    {
+        if (!consume('"'))
+            return false;
+        size_t start = pos;
+        while (true)
+        {
+            pos = scan_plain(pos);
+            if (pos >= text.size())
+                return false;
+            char c = text[pos];
+            if (c == '"')
+                break;
+            if (c != '\\' || ++pos >= text.size())
+                return false;
+            char escaped = text[pos++];
+            if (escaped == 'u')
+            {
+                // Same checks as read_string, so a string that passes here also decodes
+                uint32_t code;
+                if (!read_hex4(code))
+                    return false;
+                if (code >= 0xD800 && code <= 0xDBFF && text.substr(pos, 2) == "\\u")
+                {
+                    pos += 2;
+                    uint32_t low;
+                    if (!read_hex4(low) || low < 0xDC00 || low > 0xDFFF)
+                        return false;
+                }
+            }
+            else if (std::string_view("\"\\/bfnrt").find(escaped) == std::string_view::npos)
+                return false;
+        }
+        if (raw)
+            *raw = text.substr(start, pos - start);
+        pos++;
+        return true;
+    }
+
+    size_t position() const { return pos; }
+
+    // An integer that fits in an int, rejects fractions and exponents
+    bool read_int(int &out)
+    {
+        skip_whitespace();
+        size_t start = pos;
+        if (pos < text.size() && text[pos] == '-')
+            pos++;
+        long long value = 0;
+        size_t digits_start = pos;
+        while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9')
+        {
+            value = value * 10 + (text[pos++] - '0');
+            if (value > INT32_MAX)
+                return false;
+        }
+        if (pos == digits_start || (pos < text.size() && (text[pos] == '.' || text[pos] == 'e' || text[pos] == 'E')))
+        {
+            pos = start;
+            return false;
+        }
+        out = static_cast<int>(text[start] == '-' ? -value : value);
+        return true;
+    }
+
+    // Skips one value of any type, checking that it is well formed
+    bool skip_value(int depth = 0)
+    {
+        if (depth > 64)
+            return false;
+
+        char c = peek();
+        if (c == '"')
+            return skip_string();
+        if (c == '{' || c == '[')
+        {
+            char close = c == '{' ? '}' : ']';
+            pos++;
+            if (consume(close))
+                return true;
+            while (true)
+            {
+                if (c == '{' && (!skip_string() || !consume(':')))
+                    return false;
+                if (!skip_value(depth + 1))
+                    return false;
+                if (consume(close))
+                    return true;
+                if (!consume(','))
+                    return false;
+            }
+        }
+        if (c == 't')
+            return skip_literal("true");
+        if (c == 'f')
+            return skip_literal("false");
+        if (c == 'n')
+            return skip_literal("null");
+
+        // Number: -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?
+        if (pos < text.size() && text[pos] == '-')
+            pos++;
+        if (pos < text.size() && text[pos] == '0')
+            pos++;
+        else if (!skip_digits())
+            return false;
+        if (pos < text.size() && text[pos] == '.')
+        {
+            pos++;
+            if (!skip_digits())
+                return false;
+        }
+        if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E'))
+        {
+            pos++;
+            if (pos < text.size() && (text[pos] == '+' || text[pos] == '-'))
+                pos++;
+            if (!skip_digits())
+                return false;
+        }
+        return true;
+    }
+};
+
+// Top-level members of a JSON object, located in one pass over the text without decoding anything.
+// Values are decoded only when asked for, so the members a handler does not read cost a scan.
+class JsonObjectIndex
+{
+    struct member
+    {
+        std::string_view key;   // raw, between the quotes
+        std::string_view value; // raw JSON text of the value
+    };
+
+    std::vector<member> members;
+    bool valid = false;
+
+    static bool key_equals(std::string_view raw, std::string_view key)
+    {
+        if (raw.find('\\') == std::string_view::npos)
+            return raw == key;
+        std::string quoted = "\"" + std::string(raw) + "\"";
+        std::string decoded;
+        JsonCursor cursor(quoted);
+        return cursor.read_string(decoded) && decoded == key;
+    }
+
+    // A repeated key gives its last value
+    const member *find(std::string_view key) const
+    {
+        for (auto it = members.rbegin(); it != members.rend(); ++it)
+        {
+            if (key_equals(it->key, key))
+                return &*it;
+        }
+        return nullptr;
+    }
+
+public:
+    explicit JsonObjectIndex(std::string_view text)
+    {
+        JsonCursor cursor(text);
+        if (!cursor.consume('{'))
+            return;
+        if (!cursor.consume('}'))
+        {
+            while (true)
+            {
+                std::string_view key;
+                if (!cursor.skip_string(&key) || !cursor.consume(':'))
+                    return;
+                cursor.skip_whitespace();
+                size_t start = cursor.position();
+                if (!cursor.skip_value())
+                    return;
+                members.push_back({key, text.substr(start, cursor.position() - start)});
+
+                if (cursor.consume('}'))
+                    break;
+                if (!cursor.consume(','))
+                    return;
+            }
+        }
+        valid = cursor.at_end();
+    }
+
+    // False when the text is not one well-formed JSON object
+    bool is_valid() const { return valid; }
+
+    bool contains(std::string_view key) const { return find(key) != nullptr; }
+
+    // Decodes the member into out, false (and out empty) when it is missing or not a string
+    bool get_string(std::string_view key, std::string &out) const
+    {
+        out.clear();
+        const member *m = find(key);
+        if (!m)
+            return false;
+        out.reserve(m->value.size());
+        JsonCursor cursor(m->value);
+        if (!cursor.read_string(out) || !cursor.at_end())
+        {
+            out.clear();
+            return false;
+        }
+        return true;
+    }
+
+    bool get_int(std::string_view key, int &out) const
+    {
+        const member *m = find(key);
+        if (!m)
+            return false;
+        JsonCursor cursor(m->value);
+        return cursor.read_int(out) && cursor.at_end();
+    }
+};
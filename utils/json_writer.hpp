@@ -0,0 +1,195 @@
+#pragma once
+#include "../models/models.hpp"
+#include "../models/blog_repository.hpp"
+#include "tracing.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Streams blogs as JSON straight into one output buffer, without building a JsonObject tree
+
+// Blog fields selectable with ?fields=
+enum blog_field : unsigned
+{
+    BLOG_FIELD_ID = 1u << 0,
+    BLOG_FIELD_TITLE = 1u << 1,
+    BLOG_FIELD_CONTENT = 1u << 2,
+    BLOG_FIELD_PREVIEW_CONTENT = 1u << 3,
+    BLOG_FIELD_CREATED_AT = 1u << 4,
+    BLOG_FIELDS_ALL = (1u << 5) - 1
+};
+
+// Parses a comma separated field list ("id,title,created_at"), false on an unknown field
+bool parse_blog_fields(const std::string &list, unsigned &fields)
+{
+    fields = 0;
+    size_t pos = 0;
+    while (pos <= list.size())
+    {
+        size_t comma = list.find(',', pos);
+        std::string name = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? list.size() + 1 : comma + 1;
+
+        if (name == "id")
+            fields |= BLOG_FIELD_ID;
+        else if (name == "title")
+            fields |= BLOG_FIELD_TITLE;
+        else if (name == "content")
+            fields |= BLOG_FIELD_CONTENT;
+        else if (name == "preview_content")
+            fields |= BLOG_FIELD_PREVIEW_CONTENT;
+        else if (name == "created_at")
+            fields |= BLOG_FIELD_CREATED_AT;
+        else if (!name.empty())
+            return false;
+    }
+    return fields != 0;
+}
+
+// Appends value as a quoted JSON string
+void append_json_string(std::string &out, std::string_view value)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    out += '"';
+    size_t run_start = 0;
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\')
+            continue;
+
+        out.append(value.data() + run_start, i - run_start);
+        run_start = i + 1;
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        case '\b':
+            out += "\\b";
+            break;
+        case '\f':
+            out += "\\f";
+            break;
+        default:
+            out += "\\u00";
+            out += hex[c >> 4];
+            out += hex[c & 0xF];
+        }
+    }
+    out.append(value.data() + run_start, value.size() - run_start);
+    out += '"';
+}
+
+// Upper bound for a blog's JSON when nothing needs escaping
+size_t estimated_blog_json_size(const Blog &blog, unsigned fields = BLOG_FIELDS_ALL)
+{
+    return 96 + (fields & BLOG_FIELD_TITLE ? blog.get_title().size() : 0) +
+           (fields & BLOG_FIELD_CONTENT ? blog.get_content().size() : 0) +
+           (fields & BLOG_FIELD_PREVIEW_CONTENT ? blog.get_preview_content().size() : 0) +
+           (fields & BLOG_FIELD_CREATED_AT ? blog.get_created_at().size() : 0);
+}
+
+// Appends {"id":..,"title":..,"content":..,"preview_content":..,"created_at":..}, limited to fields
+void append_blog_json(std::string &out, const Blog &blog, unsigned fields = BLOG_FIELDS_ALL)
+{
+    char separator = '{';
+    auto key = [&](const char *name)
+    {
+        out += separator;
+        out += '"';
+        out += name;
+        out += "\":";
+        separator = ',';
+    };
+
+    if (fields & BLOG_FIELD_ID)
+    {
+        key("id");
+        out += std::to_string(blog.get_id());
+    }
+    if (fields & BLOG_FIELD_TITLE)
+    {
+        key("title");
+        append_json_string(out, blog.get_title());
+    }
+    if (fields & BLOG_FIELD_CONTENT)
+    {
+        key("content");
+        append_json_string(out, blog.get_content());
+    }
+    if (fields & BLOG_FIELD_PREVIEW_CONTENT)
+    {
+        key("preview_content");
+        append_json_string(out, blog.get_preview_content());
+    }
+    if (fields & BLOG_FIELD_CREATED_AT)
+    {
+        key("created_at");
+        append_json_string(out, blog.get_created_at());
+    }
+    if (separator == '{')
+        out += '{';
+    out += '}';
+}
+
+std::string blog_to_json_string(const Blog &blog)
+{
+    TRACE_SPAN("blog_to_json_string");
+    std::string out;
+    out.reserve(estimated_blog_json_size(blog));
+    append_blog_json(out, blog);
+    return out;
+}
+
+// The JSON of an entry, serialized once per published version
+std::shared_ptr<const std::string> cached_blog_json(const BlogEntry &entry)
+{
+    return entry.renderings->get(BlogRenderings::blog_json, 0, [&]
+                                 { return blog_to_json_string(*entry.blog); });
+}
+
+// {"blogs":[...],"count":N} in a single pre-reserved buffer.
+// A paged listing also gets "next_after": the cursor of the next page, or null on the last one.
+std::string blogs_to_json_string(const std::vector<Blog> &blogs, unsigned fields = BLOG_FIELDS_ALL,
+                                 bool paged = false, int next_after = -1)
+{
+    TRACE_SPAN("blogs_to_json_string");
+    size_t estimate = 48;
+    for (const auto &blog : blogs)
+    {
+        estimate += estimated_blog_json_size(blog, fields) + 1;
+    }
+
+    std::string out;
+    out.reserve(estimate);
+    out += "{\"blogs\":[";
+    for (size_t i = 0; i < blogs.size(); i++)
+    {
+        if (i > 0)
+            out += ',';
+        append_blog_json(out, blogs[i], fields);
+    }
+    out += "],\"count\":";
+    out += std::to_string(blogs.size());
+    if (paged)
+    {
+        out += ",\"next_after\":";
+        out += next_after >= 0 ? std::to_string(next_after) : "null";
+    }
+    out += '}';
+    return out;
+}
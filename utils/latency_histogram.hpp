@@ -0,0 +1,81 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Log-linear (HDR-style) latency buckets: 16 sub-buckets per power of two, ~6% error.
+// Kept free of the web framework so the load generator can use them too.
+namespace metrics
+{
+    constexpr size_t SUB_BUCKETS = 16;
+    constexpr size_t BUCKETS = SUB_BUCKETS + (64 - 4) * SUB_BUCKETS;
+
+    size_t bucket_of(uint64_t nanos)
+    {
+        if (nanos < SUB_BUCKETS)
+            return static_cast<size_t>(nanos);
+        int exponent = 63 - __builtin_clzll(nanos);
+        size_t sub = static_cast<size_t>(nanos >> (exponent - 4)) & (SUB_BUCKETS - 1);
+        return SUB_BUCKETS + static_cast<size_t>(exponent - 4) * SUB_BUCKETS + sub;
+    }
+
+    // Largest value that falls into bucket
+    uint64_t bucket_upper_bound(size_t bucket)
+    {
+        if (bucket < SUB_BUCKETS)
+            return bucket;
+        size_t exponent = (bucket - SUB_BUCKETS) / SUB_BUCKETS + 4;
+        uint64_t sub = (bucket - SUB_BUCKETS) % SUB_BUCKETS;
+        uint64_t lower = (SUB_BUCKETS + sub) << (exponent - 4);
+        return lower + (uint64_t(1) << (exponent - 4)) - 1;
+    }
+
+    // Bucket holding the q-quantile of counts (BUCKETS of them), total is their sum and not 0
+    size_t quantile_bucket(const std::vector<uint64_t> &counts, uint64_t total, double q)
+    {
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total - 1)) + 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < BUCKETS; b++)
+        {
+            seen += counts[b];
+            if (seen >= rank)
+                return b;
+        }
+        return BUCKETS - 1;
+    }
+}
+
+// Single-threaded histogram over those buckets that also keeps the exact maximum
+class latency_histogram
+{
+    std::vector<uint64_t> counts = std::vector<uint64_t>(metrics::BUCKETS, 0);
+    uint64_t total = 0;
+    uint64_t max_nanos = 0;
+
+public:
+    void record(uint64_t nanos)
+    {
+        counts[metrics::bucket_of(nanos)]++;
+        total++;
+        max_nanos = std::max(max_nanos, nanos);
+    }
+
+    void merge(const latency_histogram &other)
+    {
+        for (size_t b = 0; b < metrics::BUCKETS; b++)
+            counts[b] += other.counts[b];
+        total += other.total;
+        max_nanos = std::max(max_nanos, other.max_nanos);
+    }
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return max_nanos; }
+
+    uint64_t percentile(double q) const
+    {
+        if (total == 0)
+            return 0;
+        return std::min(metrics::bucket_upper_bound(metrics::quantile_bucket(counts, total, q)), max_nanos);
+    }
+};
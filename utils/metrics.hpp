@@ -0,0 +1,388 @@
+#pragma once
+#include "../definentions.hpp"
+#include "../library/web-lib.hpp"
+#include "tracing.hpp"
+#include "latency_histogram.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Per-route, per-status request metrics with per-thread shards.
+//
+// Every thread records into its own shard with relaxed atomic adds, so the hot path never
+// contends. A scrape walks all shards and merges them into Prometheus text format.
+// Latencies go into the log-linear buckets of latency_histogram.hpp.
+namespace metrics
+{
+    constexpr size_t MAX_ROUTES = 128;
+    constexpr int MIN_STATUS = 100;
+    constexpr int MAX_STATUS = 599;
+    constexpr size_t STATUS_SLOTS = MAX_STATUS - MIN_STATUS + 1;
+
+    struct histogram
+    {
+        std::array<std::atomic<uint64_t>, BUCKETS> counts{};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> sum_nanos{0};
+        std::atomic<uint64_t> bytes_out{0};
+
+        void record(uint64_t nanos, uint64_t bytes)
+        {
+            counts[bucket_of(nanos)].fetch_add(1, std::memory_order_relaxed);
+            total.fetch_add(1, std::memory_order_relaxed);
+            sum_nanos.fetch_add(nanos, std::memory_order_relaxed);
+            bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    };
+
+    // One thread's view of one route, histograms are created on the first request with a status
+    struct route_shard
+    {
+        std::array<std::atomic<histogram *>, STATUS_SLOTS> by_status{};
+        std::atomic<uint64_t> exceptions{0};
+
+        ~route_shard()
+        {
+            for (auto &slot : by_status)
+                delete slot.load();
+        }
+
+        histogram &for_status(int status)
+        {
+            if (status < MIN_STATUS || status > MAX_STATUS)
+                status = 500;
+            auto &slot = by_status[status - MIN_STATUS];
+            histogram *existing = slot.load(std::memory_order_acquire);
+            if (existing)
+                return *existing;
+
+            // Only the owning thread creates histograms, the release store publishes it to scrapers
+            auto *created = new histogram();
+            slot.store(created, std::memory_order_release);
+            return *created;
+        }
+    };
+
+    struct shard
+    {
+        std::array<std::atomic<route_shard *>, MAX_ROUTES> routes{};
+
+        ~shard()
+        {
+            for (auto &route : routes)
+                delete route.load();
+        }
+
+        route_shard &for_route(size_t route)
+        {
+            route_shard *existing = routes[route].load(std::memory_order_acquire);
+            if (existing)
+                return *existing;
+            auto *created = new route_shard();
+            routes[route].store(created, std::memory_order_release);
+            return *created;
+        }
+    };
+
+    // Route names and the shards of every thread that recorded something.
+    // Shards live as long as the registry, so a scrape never races a thread exit.
+    class registry
+    {
+        std::mutex mutex;
+        std::vector<std::string> route_names;
+        std::vector<std::unique_ptr<shard>> shards;
+
+    public:
+        size_t register_route(const std::string &name)
+        {
+            std::lock_guard lock(mutex);
+            for (size_t i = 0; i < route_names.size(); i++)
+            {
+                if (route_names[i] == name)
+                    return i;
+            }
+            if (route_names.size() >= MAX_ROUTES)
+                throw std::runtime_error("Too many instrumented routes");
+            route_names.push_back(name);
+            return route_names.size() - 1;
+        }
+
+        shard &local_shard()
+        {
+            thread_local shard *mine = nullptr;
+            if (!mine)
+            {
+                std::lock_guard lock(mutex);
+                shards.push_back(std::make_unique<shard>());
+                mine = shards.back().get();
+            }
+            return *mine;
+        }
+
+        void record(size_t route, int status, std::chrono::nanoseconds elapsed, uint64_t bytes)
+        {
+            local_shard().for_route(route).for_status(status).record(static_cast<uint64_t>(elapsed.count()), bytes);
+        }
+
+        void record_exception(size_t route)
+        {
+            local_shard().for_route(route).exceptions.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::string scrape();
+    };
+
+    registry &get_registry()
+    {
+        static registry instance;
+        return instance;
+    }
+
+    std::string escape_label(const std::string &value)
+    {
+        std::string out;
+        for (char c : value)
+        {
+            if (c == '\\' || c == '"')
+                out += '\\';
+            if (c == '\n')
+            {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    std::string format_seconds(uint64_t nanos)
+    {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(nanos) / 1e9);
+        return buffer;
+    }
+
+    // Merges every shard and renders the Prometheus text exposition format
+    std::string registry::scrape()
+    {
+        // Bucket boundaries exported for the Prometheus histogram, in seconds
+        static const std::vector<double> boundaries = {0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005,
+                                                       0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10};
+        static const std::vector<double> quantiles = {0.5, 0.9, 0.99, 0.999};
+
+        std::vector<std::string> names;
+        std::vector<shard *> all_shards;
+        {
+            std::lock_guard lock(mutex);
+            names = route_names;
+            for (auto &s : shards)
+                all_shards.push_back(s.get());
+        }
+
+        std::string buckets_out, sum_out, count_out, requests_out, errors_out, bytes_out, quantiles_out;
+        for (size_t route = 0; route < names.size(); route++)
+        {
+            std::string route_label = "route=\"" + escape_label(names[route]) + "\"";
+            uint64_t exceptions = 0;
+            uint64_t server_errors = 0;
+            uint64_t route_bytes = 0;
+
+            for (auto *s : all_shards)
+            {
+                route_shard *rs = s->routes[route].load(std::memory_order_acquire);
+                if (rs)
+                    exceptions += rs->exceptions.load(std::memory_order_relaxed);
+            }
+
+            std::vector<uint64_t> merged(BUCKETS);
+            std::vector<histogram *> found;
+            for (int status = MIN_STATUS; status <= MAX_STATUS; status++)
+            {
+                found.clear();
+                for (auto *s : all_shards)
+                {
+                    route_shard *rs = s->routes[route].load(std::memory_order_acquire);
+                    histogram *h = rs ? rs->by_status[status - MIN_STATUS].load(std::memory_order_acquire) : nullptr;
+                    if (h)
+                        found.push_back(h);
+                }
+                if (found.empty())
+                    continue;
+
+                std::fill(merged.begin(), merged.end(), 0);
+                uint64_t total = 0, sum = 0, bytes = 0;
+                for (auto *h : found)
+                {
+                    for (size_t b = 0; b < BUCKETS; b++)
+                        merged[b] += h->counts[b].load(std::memory_order_relaxed);
+                    total += h->total.load(std::memory_order_relaxed);
+                    sum += h->sum_nanos.load(std::memory_order_relaxed);
+                    bytes += h->bytes_out.load(std::memory_order_relaxed);
+                }
+                if (total == 0)
+                    continue;
+
+                if (status >= 500)
+                    server_errors += total;
+                route_bytes += bytes;
+
+                std::string labels = route_label + ",status=\"" + std::to_string(status) + "\"";
+
+                size_t bucket = 0;
+                uint64_t cumulative = 0;
+                for (double boundary : boundaries)
+                {
+                    auto limit = static_cast<uint64_t>(boundary * 1e9);
+                    while (bucket < BUCKETS && bucket_upper_bound(bucket) <= limit)
+                        cumulative += merged[bucket++];
+                    char le[32];
+                    std::snprintf(le, sizeof(le), "%g", boundary);
+                    buckets_out += "simple_blog_request_duration_seconds_bucket{" + labels + ",le=\"" + le + "\"} " + std::to_string(cumulative) + "\n";
+                }
+                uint64_t merged_total = 0;
+                for (auto count : merged)
+                    merged_total += count;
+                buckets_out += "simple_blog_request_duration_seconds_bucket{" + labels + ",le=\"+Inf\"} " + std::to_string(merged_total) + "\n";
+                sum_out += "simple_blog_request_duration_seconds_sum{" + labels + "} " + format_seconds(sum) + "\n";
+                count_out += "simple_blog_request_duration_seconds_count{" + labels + "} " + std::to_string(merged_total) + "\n";
+                requests_out += "simple_blog_requests_total{" + labels + "} " + std::to_string(total) + "\n";
+
+                for (double q : quantiles)
+                {
+                    char label[16];
+                    std::snprintf(label, sizeof(label), "%g", q);
+                    quantiles_out += "simple_blog_request_latency_seconds{" + labels + ",quantile=\"" + label + "\"} " +
+                                     format_seconds(bucket_upper_bound(quantile_bucket(merged, merged_total, q))) + "\n";
+                }
+            }
+
+            if (exceptions || server_errors)
+                errors_out += "simple_blog_errors_total{" + route_label + "} " + std::to_string(exceptions + server_errors) + "\n";
+            if (route_bytes)
+                bytes_out += "simple_blog_response_bytes_total{" + route_label + "} " + std::to_string(route_bytes) + "\n";
+        }
+
+        return "# HELP simple_blog_request_duration_seconds Handler chain latency per route and status.\n"
+               "# TYPE simple_blog_request_duration_seconds histogram\n" +
+               buckets_out + sum_out + count_out +
+               "# HELP simple_blog_request_latency_seconds Latency quantiles from the HDR buckets.\n"
+               "# TYPE simple_blog_request_latency_seconds gauge\n" +
+               quantiles_out +
+               "# HELP simple_blog_requests_total Requests per route and status.\n"
+               "# TYPE simple_blog_requests_total counter\n" +
+               requests_out +
+               "# HELP simple_blog_errors_total 5xx responses and handler exceptions per route.\n"
+               "# TYPE simple_blog_errors_total counter\n" +
+               errors_out +
+               "# HELP simple_blog_response_bytes_total Response body bytes per route.\n"
+               "# TYPE simple_blog_response_bytes_total counter\n" +
+               bytes_out;
+    }
+}
+
+namespace metrics
+{
+    // Body size of the response being built on this thread, SIZE_MAX until set_response_body runs
+    thread_local size_t response_body_bytes = SIZE_MAX;
+}
+
+// Sets the body of res and notes its size, so instrument() need not copy the body back out to measure it
+void set_response_body(std::shared_ptr<hh_web::web_response> res, const std::string &body)
+{
+    metrics::response_body_bytes = body.size();
+    res->set_body(body);
+}
+
+// Wraps a Route_V chain into one handler that times it and records the result under name
+hh_web::web_request_handler_t<> instrument(const std::string &name, std::vector<hh_web::web_request_handler_t<>> chain)
+{
+    size_t route = metrics::get_registry().register_route(name);
+    const char *span_name = tracing::get_tracer().intern(name);
+
+    return [route, span_name, chain = std::move(chain)](std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+    {
+        tracing::request_scope trace(span_name);
+        auto start = std::chrono::steady_clock::now();
+        auto code = hh_web::exit_code::CONTINUE;
+        metrics::response_body_bytes = SIZE_MAX;
+        try
+        {
+            for (const auto &handler : chain)
+            {
+                code = handler(req, res);
+                if (code != hh_web::exit_code::CONTINUE)
+                    break;
+            }
+        }
+        catch (...)
+        {
+            metrics::get_registry().record_exception(route);
+            throw;
+        }
+
+        // Only a body set some other way (send_text) has to be measured from a copy
+        size_t bytes = metrics::response_body_bytes != SIZE_MAX ? metrics::response_body_bytes : res->get_body().size();
+        metrics::get_registry().record(route, res->get_status_code(), std::chrono::steady_clock::now() - start, bytes);
+        return code;
+    };
+}
+
+// Wraps each handler of chain in a span named after it. names is the handler list as written, "admin_auth, check_body, ..."
+std::vector<hh_web::web_request_handler_t<>> trace_stages(const std::string &names, std::vector<hh_web::web_request_handler_t<>> chain)
+{
+    std::vector<hh_web::web_request_handler_t<>> traced;
+    size_t pos = 0;
+    for (auto &handler : chain)
+    {
+        size_t comma = names.find(',', pos);
+        std::string name = names.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        pos = comma == std::string::npos ? names.size() : comma + 1;
+        name.erase(0, name.find_first_not_of(" \t\n"));
+        name.erase(name.find_last_not_of(" \t\n") + 1);
+
+        const char *span_name = tracing::get_tracer().intern(name);
+        traced.push_back([span_name, handler = std::move(handler)](std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+                         {
+                             tracing::span stage(span_name);
+                             return handler(req, res);
+                         });
+    }
+    return traced;
+}
+
+// Router whose routes are all instrumented, labelled "<METHOD> <path pattern>"
+class InstrumentedRouter
+{
+    std::shared_ptr<hh_web::web_router<>> router;
+
+public:
+    explicit InstrumentedRouter(std::shared_ptr<hh_web::web_router<>> router) : router(std::move(router)) {}
+
+    void get(const std::string &path, std::vector<hh_web::web_request_handler_t<>> chain)
+    {
+        router->get(path, Route_V(instrument("GET " + path, std::move(chain))));
+    }
+
+    void post(const std::string &path, std::vector<hh_web::web_request_handler_t<>> chain)
+    {
+        router->post(path, Route_V(instrument("POST " + path, std::move(chain))));
+    }
+
+    void put(const std::string &path, std::vector<hh_web::web_request_handler_t<>> chain)
+    {
+        router->put(path, Route_V(instrument("PUT " + path, std::move(chain))));
+    }
+
+    void delete_(const std::string &path, std::vector<hh_web::web_request_handler_t<>> chain)
+    {
+        router->delete_(path, Route_V(instrument("DELETE " + path, std::move(chain))));
+    }
+};
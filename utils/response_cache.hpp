@@ -0,0 +1,149 @@
+#pragma once
+#include "../library/web-lib.hpp"
+#include "conditional_get.hpp"
+#include "metrics.hpp"
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Final bytes of a rendered GET response
+struct CachedResponse
+{
+    std::string body;
+    std::vector<std::pair<std::string, std::string>> headers;
+    Validators validators; // empty etag when the route sends none
+};
+
+// Rendered pages and JSON keyed by route (and blog id), dropped by the write controllers.
+//
+// Every invalidation bumps a generation counter. A reader captures the generation before
+// it reads the blogs and only stores its result if nothing was invalidated meanwhile,
+// so a slow render can never put a stale page back after a write.
+class ResponseCache
+{
+    mutable std::shared_mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<const CachedResponse>> entries;
+    std::atomic<uint64_t> current_generation{0};
+    std::atomic<bool> enabled{true};
+
+public:
+    // Disabled in dev mode, where templates can change under a cached page
+    void set_enabled(bool on)
+    {
+        enabled.store(on);
+        clear();
+    }
+
+    uint64_t generation() const
+    {
+        return current_generation.load(std::memory_order_acquire);
+    }
+
+    std::shared_ptr<const CachedResponse> get(const std::string &key) const
+    {
+        if (!enabled.load(std::memory_order_relaxed))
+            return nullptr;
+        std::shared_lock lock(mutex);
+        auto it = entries.find(key);
+        return it == entries.end() ? nullptr : it->second;
+    }
+
+    void put(const std::string &key, std::shared_ptr<const CachedResponse> response, uint64_t seen_generation)
+    {
+        if (!enabled.load(std::memory_order_relaxed))
+            return;
+        std::unique_lock lock(mutex);
+        if (seen_generation != generation())
+            return;
+        entries[key] = std::move(response);
+    }
+
+    void invalidate(const std::vector<std::string> &keys)
+    {
+        std::unique_lock lock(mutex);
+        current_generation.fetch_add(1, std::memory_order_acq_rel);
+        for (const auto &key : keys)
+        {
+            entries.erase(key);
+        }
+    }
+
+    void clear()
+    {
+        std::unique_lock lock(mutex);
+        current_generation.fetch_add(1, std::memory_order_acq_rel);
+        entries.clear();
+    }
+};
+
+ResponseCache &response_cache()
+{
+    static ResponseCache cache;
+    return cache;
+}
+
+// Cache keys for the cached GET routes. A single blog's page and JSON are not among them,
+// they are kept with the blog's entry in the repository (see BlogRenderings).
+namespace response_keys
+{
+    const std::string INDEX = "GET /";
+    const std::string ADMIN_DASHBOARD = "GET /admin/dashboard";
+    const std::string API_BLOGS = "GET /api/blogs";
+}
+
+// Drops everything a committed write can change: the listings. Call it once per commit, however
+// many blogs it touched. A blog's own page and JSON belong to the entry the write replaces.
+void invalidate_blog_responses()
+{
+    response_cache().invalidate({response_keys::INDEX,
+                                 response_keys::ADMIN_DASHBOARD,
+                                 response_keys::API_BLOGS});
+}
+
+// Sends the cached response for key if there is one, or a 304 if the client already has it
+bool send_cached_response(std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res, const std::string &key)
+{
+    auto cached = response_cache().get(key);
+    if (!cached)
+        return false;
+
+    if (!cached->validators.etag.empty() && send_not_modified_if_current(req, res, cached->validators))
+        return true;
+
+    for (const auto &[name, value] : cached->headers)
+    {
+        res->set_header(name, value);
+    }
+    set_response_body(res, cached->body);
+    return true;
+}
+
+// Sends body with its validators, without caching it
+void send_response(std::shared_ptr<hh_web::web_response> res, const std::string &content_type, const std::string &body,
+                   const Validators &validators = {})
+{
+    if (!validators.etag.empty())
+    {
+        set_validator_headers(res, validators);
+    }
+    res->set_header("Content-Type", content_type);
+    set_response_body(res, body);
+}
+
+// Sends body and stores it under key, generation is the value read before the blogs were loaded
+void send_and_cache_response(std::shared_ptr<hh_web::web_response> res, const std::string &key, uint64_t generation,
+                             const std::string &content_type, std::string body, const Validators &validators = {})
+{
+    auto response = std::make_shared<CachedResponse>();
+    response->headers.emplace_back("Content-Type", content_type);
+    response->body = std::move(body);
+    response->validators = validators;
+    send_response(res, content_type, response->body, validators);
+
+    response_cache().put(key, std::move(response), generation);
+}
@@ -0,0 +1,249 @@
+#pragma once
+#include "../library/web-lib.hpp"
+#include "conditional_get.hpp"
+#include "metrics.hpp"
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef SIMPLE_BLOG_HAS_BROTLI
+#include <brotli/encode.h>
+#endif
+
+// A file from static/ held in memory with its precompressed variants
+struct StaticAsset
+{
+    std::string content_type;
+    std::string cache_control;
+    std::time_t last_modified = 0;
+
+    // Body and strong ETag per content coding, gzip/brotli are empty when they would not be smaller
+    std::string identity, identity_etag;
+    std::string gzip, gzip_etag;
+    std::string brotli, brotli_etag;
+};
+
+std::string gzip_compress(const std::string &data)
+{
+    z_stream stream{};
+    // 15 window bits + 16 selects the gzip wrapper
+    if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+        return {};
+
+    std::string out(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(&out[0]);
+    stream.avail_out = static_cast<uInt>(out.size());
+
+    int result = deflate(&stream, Z_FINISH);
+    out.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? out : std::string();
+}
+
+std::string brotli_compress(const std::string &data)
+{
+#ifdef SIMPLE_BLOG_HAS_BROTLI
+    size_t size = BrotliEncoderMaxCompressedSize(data.size());
+    if (size == 0)
+        return {};
+    std::string out(size, '\0');
+    if (!BrotliEncoderCompress(BROTLI_MAX_QUALITY, BROTLI_DEFAULT_WINDOW, BROTLI_MODE_TEXT,
+                               data.size(), reinterpret_cast<const uint8_t *>(data.data()),
+                               &size, reinterpret_cast<uint8_t *>(&out[0])))
+        return {};
+    out.resize(size);
+    return out;
+#else
+    (void)data;
+    return {};
+#endif
+}
+
+std::string content_type_for(const std::filesystem::path &path)
+{
+    static const std::unordered_map<std::string, std::string> types = {
+        {".css", "text/css"},
+        {".js", "application/javascript"},
+        {".html", "text/html"},
+        {".json", "application/json"},
+        {".txt", "text/plain"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".jpeg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".ico", "image/x-icon"},
+        {".woff2", "font/woff2"}};
+
+    auto it = types.find(path.extension().string());
+    return it == types.end() ? "application/octet-stream" : it->second;
+}
+
+// q-value the client gives to coding in Accept-Encoding, from "*" when coding is not listed
+// and unlisted when neither is (1 for identity, which is acceptable unless refused)
+double accepted_quality(const std::vector<std::string> &accept_encoding, const std::string &coding, double unlisted = 0)
+{
+    double wildcard = -1;
+    for (const auto &header : accept_encoding)
+    {
+        size_t pos = 0;
+        while (pos < header.size())
+        {
+            size_t comma = header.find(',', pos);
+            std::string item = header.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+            pos = comma == std::string::npos ? header.size() : comma + 1;
+
+            double quality = 1;
+            size_t semicolon = item.find(';');
+            if (semicolon != std::string::npos)
+            {
+                size_t q = item.find("q=", semicolon);
+                if (q != std::string::npos)
+                    quality = std::atof(item.c_str() + q + 2);
+                item.erase(semicolon);
+            }
+            item.erase(0, item.find_first_not_of(" \t"));
+            item.erase(item.find_last_not_of(" \t") + 1);
+
+            if (item == coding)
+                return quality;
+            if (item == "*")
+                wildcard = quality;
+        }
+    }
+    return wildcard >= 0 ? wildcard : unlisted;
+}
+
+// Everything under static/, loaded at startup so static hits never touch the filesystem
+class StaticAssetCache
+{
+    std::unordered_map<std::string, std::shared_ptr<const StaticAsset>> assets;
+    std::vector<std::pair<std::string, std::string>> cache_control_rules; // url prefix -> Cache-Control
+    std::string default_cache_control = "public, max-age=3600";
+
+    std::string cache_control_for(const std::string &url) const
+    {
+        const std::pair<std::string, std::string> *best = nullptr;
+        for (const auto &rule : cache_control_rules)
+        {
+            if (url.rfind(rule.first, 0) == 0 && (!best || rule.first.size() > best->first.size()))
+                best = &rule;
+        }
+        return best ? best->second : default_cache_control;
+    }
+
+    static std::string etag_of(const std::string &body, const char *suffix)
+    {
+        return "\"" + std::to_string(std::hash<std::string>{}(body)) + suffix + "\"";
+    }
+
+public:
+    // Cache-Control for urls starting with prefix, the longest matching prefix wins. Set before load_directory.
+    void set_cache_control(const std::string &prefix, const std::string &value)
+    {
+        cache_control_rules.emplace_back(prefix, value);
+    }
+
+    void load_directory(const std::string &dir)
+    {
+        assets.clear();
+        for (const auto &file : std::filesystem::recursive_directory_iterator(dir))
+        {
+            if (!file.is_regular_file())
+                continue;
+
+            std::ifstream in(file.path(), std::ios::binary);
+            auto asset = std::make_shared<StaticAsset>();
+            asset->identity.assign((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+            std::string url = "/" + std::filesystem::relative(file.path(), dir).generic_string();
+            asset->content_type = content_type_for(file.path());
+            asset->cache_control = cache_control_for(url);
+
+            struct stat st;
+            asset->last_modified = ::stat(file.path().c_str(), &st) == 0 ? st.st_mtime : std::time(nullptr);
+
+            asset->identity_etag = etag_of(asset->identity, "");
+            std::string gzip = gzip_compress(asset->identity);
+            if (!gzip.empty() && gzip.size() < asset->identity.size())
+            {
+                asset->gzip = std::move(gzip);
+                asset->gzip_etag = etag_of(asset->identity, "-gz");
+            }
+            std::string brotli = brotli_compress(asset->identity);
+            if (!brotli.empty() && brotli.size() < asset->identity.size())
+            {
+                asset->brotli = std::move(brotli);
+                asset->brotli_etag = etag_of(asset->identity, "-br");
+            }
+
+            assets[url] = asset;
+        }
+    }
+
+    const std::unordered_map<std::string, std::shared_ptr<const StaticAsset>> &get_assets() const
+    {
+        return assets;
+    }
+};
+
+StaticAssetCache &static_assets()
+{
+    static StaticAssetCache cache;
+    return cache;
+}
+
+// Serves asset in the encoding the client ranks highest, or 304 if its copy is current.
+// Equal q-values go to the smaller body (br, then gzip, then identity). 406 when the client
+// refuses every encoding the asset has.
+hh_web::exit_code send_static_asset(const StaticAsset &asset, std::shared_ptr<hh_web::web_request> req, std::shared_ptr<hh_web::web_response> res)
+{
+    auto accept_encoding = req->get_header("Accept-Encoding");
+
+    struct variant
+    {
+        const std::string *body;
+        const std::string *etag;
+        const char *encoding;
+        double quality;
+    };
+    const variant variants[] = {
+        {&asset.brotli, &asset.brotli_etag, "br", asset.brotli.empty() ? 0 : accepted_quality(accept_encoding, "br")},
+        {&asset.gzip, &asset.gzip_etag, "gzip", asset.gzip.empty() ? 0 : accepted_quality(accept_encoding, "gzip")},
+        {&asset.identity, &asset.identity_etag, nullptr, accepted_quality(accept_encoding, "identity", 1)},
+    };
+    const variant *best = nullptr;
+    for (const auto &candidate : variants)
+    {
+        if (candidate.quality > 0 && (!best || candidate.quality > best->quality))
+            best = &candidate;
+    }
+
+    res->set_header("Vary", "Accept-Encoding");
+    if (!best)
+    {
+        res->set_status(406, "Not Acceptable");
+        set_response_body(res, "No acceptable content encoding");
+        return hh_web::exit_code::EXIT;
+    }
+    const std::string *body = best->body;
+    const std::string *etag = best->etag;
+    const char *encoding = best->encoding;
+
+    res->set_header("Cache-Control", asset.cache_control);
+    if (send_not_modified_if_current(req, res, {*etag, asset.last_modified}))
+        return hh_web::exit_code::EXIT;
+
+    res->set_header("Content-Type", asset.content_type);
+    if (encoding)
+        res->set_header("Content-Encoding", encoding);
+    set_response_body(res, *body);
+    return hh_web::exit_code::EXIT;
+}
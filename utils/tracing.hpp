@@ -0,0 +1,270 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Sampled span tracing, dumped as Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev).
+//
+// A request is picked for tracing when its root span opens, with probability sample_rate.
+// Spans inside a request that was not picked cost one thread_local read. Finished spans go
+// into a fixed-size ring buffer that overwrites the oldest entries, so tracing can stay on.
+namespace tracing
+{
+    constexpr size_t RING_SIZE = 1 << 16;
+
+    // A finished span. Fields are atomics so a dump can read a slot while it is being overwritten,
+    // seq tells it whether the copy it made is consistent.
+    struct slot
+    {
+        std::atomic<uint64_t> seq{0};
+        std::atomic<const char *> name{nullptr};
+        std::atomic<uint64_t> request{0};
+        std::atomic<uint64_t> start_nanos{0};
+        std::atomic<uint64_t> duration_nanos{0};
+        std::atomic<uint32_t> thread{0};
+    };
+
+    class tracer
+    {
+        std::array<slot, RING_SIZE> ring;
+        std::atomic<uint64_t> head{0};
+        std::atomic<uint64_t> next_request{1};
+        std::atomic<uint32_t> next_thread{1};
+        std::atomic<uint32_t> sample_threshold{0}; // out of 2^32
+        std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+        std::mutex names_mutex;
+        std::set<std::string> names;
+
+    public:
+        // Fraction of requests to trace, 0 turns tracing off and 1 traces everything
+        void set_sample_rate(double rate)
+        {
+            if (rate <= 0)
+                sample_threshold.store(0, std::memory_order_relaxed);
+            else if (rate >= 1)
+                sample_threshold.store(UINT32_MAX, std::memory_order_relaxed);
+            else
+                sample_threshold.store(static_cast<uint32_t>(rate * 4294967296.0), std::memory_order_relaxed);
+        }
+
+        double get_sample_rate() const
+        {
+            uint32_t threshold = sample_threshold.load(std::memory_order_relaxed);
+            return threshold == UINT32_MAX ? 1.0 : threshold / 4294967296.0;
+        }
+
+        // Id for a new request if it should be traced, 0 otherwise
+        uint64_t sample_request()
+        {
+            uint32_t threshold = sample_threshold.load(std::memory_order_relaxed);
+            if (threshold == 0)
+                return 0;
+
+            // xorshift per thread, good enough to pick requests
+            thread_local uint32_t state = 0x9E3779B9u ^ thread_id();
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            if (threshold != UINT32_MAX && state >= threshold)
+                return 0;
+            return next_request.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        // Span names are stored as pointers, so names built at runtime are kept here for good
+        const char *intern(const std::string &name)
+        {
+            std::lock_guard lock(names_mutex);
+            return names.insert(name).first->c_str();
+        }
+
+        uint32_t thread_id()
+        {
+            thread_local uint32_t id = next_thread.fetch_add(1, std::memory_order_relaxed);
+            return id;
+        }
+
+        uint64_t now_nanos() const
+        {
+            return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count());
+        }
+
+        void record(const char *name, uint64_t request, uint64_t start, uint64_t end)
+        {
+            uint64_t index = head.fetch_add(1, std::memory_order_relaxed);
+            slot &s = ring[index & (RING_SIZE - 1)];
+
+            s.seq.store(index * 2 + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            s.name.store(name, std::memory_order_relaxed);
+            s.request.store(request, std::memory_order_relaxed);
+            s.start_nanos.store(start, std::memory_order_relaxed);
+            s.duration_nanos.store(end - start, std::memory_order_relaxed);
+            s.thread.store(thread_id(), std::memory_order_relaxed);
+            s.seq.store(index * 2 + 2, std::memory_order_release);
+        }
+
+        // The ring buffer as {"traceEvents":[...]}, oldest span first
+        std::string dump_chrome_json();
+    };
+
+    tracer &get_tracer()
+    {
+        static tracer instance;
+        return instance;
+    }
+
+    // Request id of the traced request running on this thread, 0 when none
+    uint64_t &current_request()
+    {
+        thread_local uint64_t request = 0;
+        return request;
+    }
+
+    // Times the enclosing scope when the current request is traced. name must outlive the tracer.
+    class span
+    {
+        const char *name;
+        uint64_t request;
+        uint64_t start = 0;
+
+    public:
+        explicit span(const char *name) : name(name), request(current_request())
+        {
+            if (request)
+                start = get_tracer().now_nanos();
+        }
+
+        ~span()
+        {
+            if (request)
+                get_tracer().record(name, request, start, get_tracer().now_nanos());
+        }
+
+        span(const span &) = delete;
+        span &operator=(const span &) = delete;
+    };
+
+    // Root span of a request, decides whether the request is traced
+    class request_scope
+    {
+        const char *name;
+        uint64_t previous;
+        uint64_t request;
+        uint64_t start = 0;
+
+    public:
+        explicit request_scope(const char *name) : name(name), previous(current_request()), request(get_tracer().sample_request())
+        {
+            current_request() = request;
+            if (request)
+                start = get_tracer().now_nanos();
+        }
+
+        ~request_scope()
+        {
+            if (request)
+                get_tracer().record(name, request, start, get_tracer().now_nanos());
+            current_request() = previous;
+        }
+
+        request_scope(const request_scope &) = delete;
+        request_scope &operator=(const request_scope &) = delete;
+    };
+
+    // Times the enclosing scope for each of requests (0 entries are skipped), for work one thread
+    // does once on behalf of several requests, like a group commit. name must outlive the tracer.
+    class shared_span
+    {
+        const char *name;
+        const std::vector<uint64_t> &requests;
+        uint64_t start = 0;
+
+    public:
+        shared_span(const char *name, const std::vector<uint64_t> &requests) : name(name), requests(requests)
+        {
+            if (!requests.empty())
+                start = get_tracer().now_nanos();
+        }
+
+        ~shared_span()
+        {
+            if (requests.empty())
+                return;
+            uint64_t end = get_tracer().now_nanos();
+            for (uint64_t request : requests)
+            {
+                if (request)
+                    get_tracer().record(name, request, start, end);
+            }
+        }
+
+        shared_span(const shared_span &) = delete;
+        shared_span &operator=(const shared_span &) = delete;
+    };
+
+    void append_escaped(std::string &out, const char *value)
+    {
+        for (const char *c = value; *c; c++)
+        {
+            if (*c == '"' || *c == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(*c) < 0x20)
+                continue;
+            out += *c;
+        }
+    }
+
+    std::string tracer::dump_chrome_json()
+    {
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t begin = end > RING_SIZE ? end - RING_SIZE : 0;
+
+        std::string out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        char number[96];
+        for (uint64_t index = begin; index < end; index++)
+        {
+            slot &s = ring[index & (RING_SIZE - 1)];
+            uint64_t seq = s.seq.load(std::memory_order_acquire);
+            if (seq != index * 2 + 2)
+                continue; // still being written, or already overwritten
+
+            const char *name = s.name.load(std::memory_order_relaxed);
+            uint64_t request = s.request.load(std::memory_order_relaxed);
+            uint64_t start = s.start_nanos.load(std::memory_order_relaxed);
+            uint64_t duration = s.duration_nanos.load(std::memory_order_relaxed);
+            uint32_t thread = s.thread.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) != seq)
+                continue;
+
+            if (!first)
+                out += ',';
+            first = false;
+            out += "{\"name\":\"";
+            append_escaped(out, name);
+            std::snprintf(number, sizeof(number), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+                          thread, start / 1000.0, duration / 1000.0);
+            out += number;
+            out += ",\"args\":{\"request\":" + std::to_string(request) + "}}";
+        }
+        out += "]}";
+        return out;
+    }
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Opens a span named name (a string literal) that ends with the enclosing scope
+#define TRACE_SPAN(name) tracing::span TRACE_CONCAT(trace_span_, __LINE__)(name)
+
+// Opens a span named name that ends with the enclosing scope, recorded under each traced request of requests
+#define TRACE_SHARED_SPAN(name, requests) tracing::shared_span TRACE_CONCAT(trace_span_, __LINE__)(name, requests)
@@ -1,6 +1,10 @@
 #pragma once
 
 #include "../models/models.hpp"
+#include "../models/blog_repository.hpp"
+#include "form_decoder.hpp"
+#include "json_writer.hpp"
+#include "metrics.hpp"
 #include "../views/views.hpp"
 #include "../library/web-lib.hpp"
 #include "../library/libs/json/json-parser.hpp"
@@ -11,31 +15,83 @@
 #include <iomanip>
 #include <algorithm>
 
-// Utility function to parse form data from request body
-std::map<std::string, std::string> parse_form_data(const std::string &body)
+// Utility function to parse form data from request body, values are fully decoded
+FormData parse_form_data(std::string_view body)
 {
-    std::map<std::string, std::string> form_data;
+    return FormData(body);
+}
 
-    std::stringstream ss(body);
-    std::string pair;
+// Longest preview_content kept from a post's content, in bytes
+const size_t PREVIEW_LENGTH = 150;
+
+// Utility function to build a blog's preview: the first PREVIEW_LENGTH bytes of content and "...",
+// cut before a UTF-8 continuation byte so a multi-byte character is never split
+std::string make_preview(std::string_view content)
+{
+    if (content.size() <= PREVIEW_LENGTH)
+        return std::string(content);
+    size_t cut = PREVIEW_LENGTH;
+    while (cut > 0 && (static_cast<unsigned char>(content[cut]) & 0xC0) == 0x80)
+        cut--;
+    return std::string(content.substr(0, cut)) + "...";
+}
+
+// Utility function to decode %XX sequences and '+' in a URL component
+std::string url_decode(std::string_view value)
+{
+    return form_decoding::decode(value, true);
+}
 
+// Utility function to parse the query string of the request URI
+std::map<std::string, std::string> parse_query_params(std::shared_ptr<hh_web::web_request> req)
+{
+    std::map<std::string, std::string> query;
+
+    std::string uri = req->get_uri();
+    size_t question = uri.find('?');
+    if (question == std::string::npos)
+        return query;
+
+    std::stringstream ss(uri.substr(question + 1));
+    std::string pair;
     while (std::getline(ss, pair, '&'))
     {
         size_t pos = pair.find('=');
-        if (pos != std::string::npos)
-        {
-            std::string key = pair.substr(0, pos);
-            std::string value = pair.substr(pos + 1);
+        if (pos == std::string::npos)
+            query[url_decode(pair)] = "";
+        else
+            query[url_decode(pair.substr(0, pos))] = url_decode(pair.substr(pos + 1));
+    }
+    return query;
+}
 
-            // Basic URL decoding (replace + with space and decode %XX sequences)
-            std::replace(value.begin(), value.end(), '+', ' ');
-            // TODO: Implement full URL decoding if needed
+// Utility function to read ?limit=&after= of a listing, false on malformed values
+bool parse_page_query(const std::map<std::string, std::string> &query, size_t default_limit, size_t max_limit, int &after, size_t &limit)
+{
+    after = 0;
+    limit = default_limit;
+    try
+    {
+        auto it = query.find("after");
+        if (it != query.end())
+        {
+            after = std::stoi(it->second);
+        }
 
-            form_data[key] = value;
+        it = query.find("limit");
+        if (it != query.end())
+        {
+            int requested = std::stoi(it->second);
+            if (requested <= 0)
+                return false;
+            limit = std::min(static_cast<size_t>(requested), max_limit);
         }
     }
-
-    return form_data;
+    catch (const std::exception &e)
+    {
+        return false;
+    }
+    return true;
 }
 
 // Utility function to get current timestamp
@@ -51,39 +107,39 @@ std::string get_current_timestamp()
 // Utility function to get blog by ID
 Blog get_blog_by_id(int id)
 {
-    auto blogs = Blog::get_blogs_from_file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
-    for (const auto &blog : blogs)
+    auto blog = blog_repository().find(id);
+    if (!blog)
     {
-        if (blog.get_id() == id)
-        {
-            return blog;
-        }
+        throw std::runtime_error("Blog not found");
     }
-    throw std::runtime_error("Blog not found");
+    return *blog;
 }
 
-// Utility function to save blogs to file
-void save_blogs_to_file(const std::vector<Blog> &blogs)
+using namespace hh_json;
+
+// Builds the page, JSON and article card of blog id as just published, so the reads after a write
+// find them ready. Write paths call it once their write is committed.
+void prerender_blog(int id)
 {
-    std::ofstream file(CPP_PROJECT_SOURCE_DIR + std::string("/blogs.db"));
-    for (const auto &blog : blogs)
-    {
-        file << blog.to_string_for_file() << std::endl;
-    }
-    file.close();
+    TRACE_SPAN("prerender_blog");
+    auto snapshot = blog_repository().snapshot();
+    const BlogEntry *entry = snapshot->find_entry(id);
+    if (!entry)
+        return;
+    cached_blog_page(*entry);
+    cached_blog_json(*entry);
+    cached_article_card(*entry);
 }
 
-using namespace hh_json;
-
 // Utility function to convert Blog to JSON object
 std::shared_ptr<JsonObject> blog_to_json(const Blog &blog)
 {
     auto json_blog = std::make_shared<JsonObject>();
     json_blog->insert("id", maker::make_number(blog.get_id()));
-    json_blog->insert("title", maker::make_string(blog.get_title()));
-    json_blog->insert("content", maker::make_string(blog.get_content()));
-    json_blog->insert("preview_content", maker::make_string(blog.get_preview_content()));
-    json_blog->insert("created_at", maker::make_string(blog.get_created_at()));
+    json_blog->insert("title", maker::make_string(std::string(blog.get_title())));
+    json_blog->insert("content", maker::make_string(std::string(blog.get_content())));
+    json_blog->insert("preview_content", maker::make_string(std::string(blog.get_preview_content())));
+    json_blog->insert("created_at", maker::make_string(std::string(blog.get_created_at())));
     return json_blog;
 }
 
@@ -92,7 +148,8 @@ void send_json_response(std::shared_ptr<hh_web::web_response> res, std::shared_p
 {
     res->set_status(status_code, status_message);
     res->set_header("Content-Type", "application/json");
-    res->set_body(json_obj->stringify());
+    TRACE_SPAN("stringify");
+    set_response_body(res, json_obj->stringify());
 }
 
 // Utility function to send JSON error response
@@ -0,0 +1,185 @@
+#pragma once
+#include <array>
+#include <charconv>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace html_escaping
+{
+    // Bytes that are replaced by an entity in text and attribute values
+    constexpr auto needs_escape = []
+    {
+        std::array<bool, 256> table{};
+        for (unsigned char c : std::string_view("&<>\"'"))
+            table[c] = true;
+        return table;
+    }();
+
+    constexpr std::string_view entity(char c)
+    {
+        switch (c)
+        {
+        case '&':
+            return "&amp;";
+        case '<':
+            return "&lt;";
+        case '>':
+            return "&gt;";
+        case '"':
+            return "&quot;";
+        default:
+            return "&#39;";
+        }
+    }
+
+    // Appends value to out with &<>"' escaped
+    void append(std::string &out, std::string_view value)
+    {
+        size_t run_start = 0;
+        for (size_t i = 0; i < value.size(); i++)
+        {
+            if (!needs_escape[static_cast<unsigned char>(value[i])])
+                continue;
+            out.append(value.data() + run_start, i - run_start);
+            out += entity(value[i]);
+            run_start = i + 1;
+        }
+        out.append(value.data() + run_start, value.size() - run_start);
+    }
+}
+
+// Writes HTML straight into the caller's buffer, for the repeated fragments of list views.
+// There are no element objects or attribute maps: tags, attributes and text are appended as
+// they come, and text and attribute values are escaped on the way in. Small pieces are staged
+// in a fixed buffer and reach the output in large appends, the rest is flushed on destruction.
+//
+//   HtmlWriter html(out);
+//   html.start("a").attribute("href", "blogs/", id).text("Read more").end("a");
+class HtmlWriter
+{
+    std::string &out;
+    char staged[1024];
+    size_t staged_size = 0;
+    bool in_start_tag = false; // "<tag ..." written, its '>' not yet
+
+    void put(const char *data, size_t size)
+    {
+        if (staged_size + size > sizeof(staged))
+        {
+            flush();
+            if (size > sizeof(staged) / 2)
+            {
+                out.append(data, size);
+                return;
+            }
+        }
+        std::memcpy(staged + staged_size, data, size);
+        staged_size += size;
+    }
+
+    void put(std::string_view value) { put(value.data(), value.size()); }
+
+    void put(char c)
+    {
+        if (staged_size == sizeof(staged))
+            flush();
+        staged[staged_size++] = c;
+    }
+
+    void close_start_tag()
+    {
+        if (in_start_tag)
+        {
+            put('>');
+            in_start_tag = false;
+        }
+    }
+
+    void put_escaped(std::string_view value)
+    {
+        size_t run_start = 0;
+        for (size_t i = 0; i < value.size(); i++)
+        {
+            if (!html_escaping::needs_escape[static_cast<unsigned char>(value[i])])
+                continue;
+            put(value.data() + run_start, i - run_start);
+            put(html_escaping::entity(value[i]));
+            run_start = i + 1;
+        }
+        put(value.data() + run_start, value.size() - run_start);
+    }
+
+    void put_part(std::string_view value) { put_escaped(value); }
+    void put_part(const char *value) { put_escaped(value); }
+    void put_part(const std::string &value) { put_escaped(value); }
+
+    void put_part(int value)
+    {
+        char digits[16];
+        auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        put(digits, result.ptr - digits);
+    }
+
+public:
+    explicit HtmlWriter(std::string &out) : out(out) {}
+    ~HtmlWriter() { flush(); }
+
+    HtmlWriter(const HtmlWriter &) = delete;
+    HtmlWriter &operator=(const HtmlWriter &) = delete;
+
+    // Opens <tag, attributes may follow until the next text, start or end
+    HtmlWriter &start(std::string_view tag)
+    {
+        close_start_tag();
+        put('<');
+        put(tag);
+        in_start_tag = true;
+        return *this;
+    }
+
+    // name="parts...", each part escaped (strings) or formatted (ints)
+    template <typename... Parts>
+    HtmlWriter &attribute(std::string_view name, const Parts &...parts)
+    {
+        put(' ');
+        put(name);
+        put("=\"", 2);
+        (put_part(parts), ...);
+        put('"');
+        return *this;
+    }
+
+    // Escaped text content, the parts are written back to back
+    template <typename... Parts>
+    HtmlWriter &text(const Parts &...parts)
+    {
+        close_start_tag();
+        (put_part(parts), ...);
+        return *this;
+    }
+
+    // Markup that is already HTML
+    HtmlWriter &raw(std::string_view html)
+    {
+        close_start_tag();
+        put(html);
+        return *this;
+    }
+
+    HtmlWriter &end(std::string_view tag)
+    {
+        close_start_tag();
+        put("</", 2);
+        put(tag);
+        put('>');
+        return *this;
+    }
+
+    // Moves what is staged into the output, done by the destructor as well
+    void flush()
+    {
+        out.append(staged, staged_size);
+        staged_size = 0;
+    }
+};
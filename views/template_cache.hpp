@@ -0,0 +1,314 @@
+#pragma once
+#include "../definentions.hpp"
+#include "html_writer.hpp"
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// A template from views/html compiled into literal segments and {{placeholder}} slots
+class CompiledTemplate
+{
+    struct segment
+    {
+        std::string text; // literal text, or the slot name
+        bool is_slot;
+    };
+
+    std::string source;
+    std::vector<segment> segments;
+    size_t literal_size = 0;
+
+    static constexpr std::string_view document_prefix = "<!DOCTYPE html>\n<html>\n";
+    static constexpr std::string_view document_suffix = "\n</html>";
+
+public:
+    using params_t = std::vector<std::pair<std::string_view, std::string_view>>;
+
+    explicit CompiledTemplate(std::string html) : source(std::move(html))
+    {
+        size_t pos = 0;
+        while (pos < source.size())
+        {
+            size_t open = source.find("{{", pos);
+            size_t close = open == std::string::npos ? std::string::npos : source.find("}}", open + 2);
+            if (close == std::string::npos)
+            {
+                segments.push_back({source.substr(pos), false});
+                literal_size += source.size() - pos;
+                break;
+            }
+
+            if (open > pos)
+            {
+                segments.push_back({source.substr(pos, open - pos), false});
+                literal_size += open - pos;
+            }
+
+            std::string name = source.substr(open + 2, close - open - 2);
+            name.erase(0, name.find_first_not_of(" \t"));
+            name.erase(name.find_last_not_of(" \t") + 1);
+            segments.push_back({name, true});
+
+            pos = close + 2;
+        }
+    }
+
+    const std::string &get_source() const { return source; }
+
+    // Substitutes params into the slots with a single pre-sized buffer.
+    // Values are text and get HTML-escaped, markup goes through render_document_with().
+    // Slots without a matching param are left as {{name}}.
+    void render_to(std::string &out, const params_t &params) const
+    {
+        size_t total = literal_size;
+        for (const auto &seg : segments)
+        {
+            if (!seg.is_slot)
+                continue;
+            const std::string_view *value = find_param(params, seg.text);
+            total += value ? value->size() : seg.text.size() + 4;
+        }
+        out.reserve(out.size() + total);
+
+        for (const auto &seg : segments)
+        {
+            if (!seg.is_slot)
+            {
+                out += seg.text;
+                continue;
+            }
+            if (const std::string_view *value = find_param(params, seg.text))
+            {
+                html_escaping::append(out, *value);
+            }
+            else
+            {
+                out += "{{";
+                out += seg.text;
+                out += "}}";
+            }
+        }
+    }
+
+    std::string render(const params_t &params) const
+    {
+        std::string out;
+        render_to(out, params);
+        return out;
+    }
+
+    // Same as render(), wrapped the way hh_html_builder::document wraps its children
+    std::string render_document(const params_t &params) const
+    {
+        std::string out;
+        out.reserve(document_prefix.size() + document_suffix.size() + literal_size);
+        out += document_prefix;
+        render_to(out, params);
+        out += document_suffix;
+        return out;
+    }
+
+    // Same as render_document() with a single slot, filled by fill(out) appending straight into
+    // the page. fill_size is an estimate of what fill writes, for the one reservation.
+    // What fill writes is markup and goes in as it is, fill escapes any text it writes.
+    template <typename Fill>
+    std::string render_document_with(std::string_view slot, size_t fill_size, Fill &&fill) const
+    {
+        std::string out;
+        out.reserve(document_prefix.size() + document_suffix.size() + literal_size + fill_size);
+        out += document_prefix;
+        for (const auto &seg : segments)
+        {
+            if (!seg.is_slot)
+                out += seg.text;
+            else if (seg.text == slot)
+                fill(out);
+            else
+            {
+                out += "{{";
+                out += seg.text;
+                out += "}}";
+            }
+        }
+        out += document_suffix;
+        return out;
+    }
+
+private:
+    static const std::string_view *find_param(const params_t &params, const std::string &name)
+    {
+        for (const auto &param : params)
+        {
+            if (param.first == name)
+                return &param.second;
+        }
+        return nullptr;
+    }
+};
+
+// Compiled templates from views/html, loaded once at startup.
+// In dev mode each lookup checks the file's mtime and recompiles it when it changed,
+// in production mode the files are never read again and lookups take no lock: they read an
+// immutable name -> template map that is only replaced when the set of templates changes.
+class TemplateCache
+{
+    struct entry
+    {
+        std::shared_ptr<const CompiledTemplate> compiled;
+        std::filesystem::file_time_type mtime;
+    };
+
+    using template_map = std::unordered_map<std::string, std::shared_ptr<const CompiledTemplate>>;
+
+    std::mutex mutex;
+    std::string directory;
+    std::unordered_map<std::string, entry> templates;
+    std::atomic<bool> reload_on_change{false};
+    std::shared_ptr<const template_map> published = std::make_shared<const template_map>(); // production lookups
+    std::atomic<uint64_t> published_version{0};
+    std::atomic<uint64_t> generation_counter{1};
+    std::atomic<std::time_t> changed_at{0}; // when generation_counter last moved
+
+    static std::shared_ptr<const CompiledTemplate> compile_file(const std::filesystem::path &path)
+    {
+        std::ifstream file(path);
+        std::string html((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        return std::make_shared<const CompiledTemplate>(std::move(html));
+    }
+
+    // Caller holds the mutex
+    void publish_templates()
+    {
+        auto map = std::make_shared<template_map>();
+        for (const auto &[name, cached] : templates)
+            map->emplace(name, cached.compiled);
+        std::atomic_store(&published, std::shared_ptr<const template_map>(std::move(map)));
+
+        // Versions are unique across caches, so a thread's copy is never mistaken for another cache's
+        static std::atomic<uint64_t> versions{0};
+        published_version.store(versions.fetch_add(1, std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // This thread's copy of the published map, reloaded only when a new one was published
+    const template_map &published_templates() const
+    {
+        struct cached_map
+        {
+            uint64_t version = 0;
+            std::shared_ptr<const template_map> map;
+        };
+        thread_local cached_map cache;
+
+        uint64_t version = published_version.load(std::memory_order_acquire);
+        if (cache.version != version || !cache.map)
+        {
+            cache.map = std::atomic_load(&published);
+            cache.version = version;
+        }
+        return *cache.map;
+    }
+
+    // Caller holds the mutex
+    void bump_generation()
+    {
+        changed_at.store(std::time(nullptr), std::memory_order_relaxed);
+        generation_counter++;
+    }
+
+public:
+    void load_directory(const std::string &dir, bool dev_mode)
+    {
+        std::lock_guard lock(mutex);
+        directory = dir;
+        reload_on_change = dev_mode;
+        templates.clear();
+
+        for (const auto &file : std::filesystem::directory_iterator(dir))
+        {
+            if (!file.is_regular_file())
+                continue;
+            templates[file.path().filename().string()] = {compile_file(file.path()), file.last_write_time()};
+        }
+        publish_templates();
+        bump_generation();
+    }
+
+    // Changes whenever a template is compiled again, so output rendered from templates can tell it
+    // is outdated. In dev mode this checks every template's mtime first.
+    uint64_t generation()
+    {
+        if (!reload_on_change)
+            return generation_counter.load(std::memory_order_acquire);
+
+        std::lock_guard lock(mutex);
+        for (auto &[name, cached] : templates)
+        {
+            std::filesystem::path path = std::filesystem::path(directory) / name;
+            std::error_code ec;
+            auto mtime = std::filesystem::last_write_time(path, ec);
+            if (!ec && mtime != cached.mtime)
+            {
+                cached = entry{compile_file(path), mtime};
+                bump_generation();
+            }
+        }
+        return generation_counter.load(std::memory_order_acquire);
+    }
+
+    // When the templates last changed, call generation() first for it to be current
+    std::time_t get_changed_at() const
+    {
+        return changed_at.load(std::memory_order_relaxed);
+    }
+
+    // Template by file name, e.g. "index.html"
+    std::shared_ptr<const CompiledTemplate> get(const std::string &name)
+    {
+        if (!reload_on_change.load(std::memory_order_relaxed))
+        {
+            const template_map &map = published_templates();
+            auto found = map.find(name);
+            if (found != map.end())
+                return found->second;
+        }
+
+        std::lock_guard lock(mutex);
+        auto it = templates.find(name);
+        if (it != templates.end() && !reload_on_change)
+            return it->second.compiled;
+
+        std::filesystem::path path = std::filesystem::path(directory.empty() ? CPP_PROJECT_SOURCE_DIR + std::string("views/html") : directory) / name;
+        std::error_code ec;
+        auto mtime = std::filesystem::last_write_time(path, ec);
+        if (ec)
+        {
+            if (it != templates.end())
+                return it->second.compiled;
+            return std::make_shared<const CompiledTemplate>(std::string());
+        }
+
+        if (it == templates.end() || it->second.mtime != mtime)
+        {
+            it = templates.insert_or_assign(name, entry{compile_file(path), mtime}).first;
+            if (!reload_on_change)
+                publish_templates();
+            bump_generation();
+        }
+        return it->second.compiled;
+    }
+};
+
+TemplateCache &template_cache()
+{
+    static TemplateCache cache;
+    return cache;
+}
@@ -1,167 +1,123 @@
 #pragma once
 #include "../definentions.hpp"
-#include "../library/libs/html-builder/html-builder.hpp"
 #include "../models/models.hpp"
+#include "../models/blog_repository.hpp"
+#include "template_cache.hpp"
+#include "html_writer.hpp"
 
-std::string index_view(const std::vector<Blog> &blogs = {})
-{
-    using namespace hh_html_builder;
-
-    auto blogs_elm = std::make_shared<element>("main");
-
-    for (const auto &blog : blogs)
-    {
-        auto article_elm = std::make_shared<element>("article");
-        article_elm->add_child(std::make_shared<element>("h2", blog.get_title()));
-        article_elm->add_child(std::make_shared<element>("p", blog.get_preview_content()));
-        article_elm->add_child(std::make_shared<element>("a", "Read more",
-                                                         std::map<std::string, std::string>({{"href", "blogs/" + std::to_string(blog.get_id())}})));
-        article_elm->add_child(std::make_shared<element>("div", "Published on: " + blog.get_created_at(),
-                                                         std::map<std::string, std::string>({{"class", "created-at"}})));
-        blogs_elm->add_child(article_elm);
-    }
-
-    document doc;
-
-    std::string index_path = CPP_PROJECT_SOURCE_DIR + std::string("views/html/index.html");
+// Markup of one list entry besides its text, for the reservation
+const size_t LIST_ITEM_MARKUP_SIZE = 160;
 
-    std::string html;
-
-    std::ifstream index_file(index_path);
-    if (index_file)
+// The <article> card of one blog on the home page
+std::string article_card_html(const Blog &blog)
+{
+    std::string out;
+    out.reserve(LIST_ITEM_MARKUP_SIZE + blog.get_title().size() + blog.get_preview_content().size() + blog.get_created_at().size());
     {
-        html.assign((std::istreambuf_iterator<char>(index_file)),
-                    (std::istreambuf_iterator<char>()));
+        HtmlWriter html(out);
+        html.start("article");
+        html.start("h2").text(blog.get_title()).end("h2");
+        html.start("p").text(blog.get_preview_content()).end("p");
+        html.start("a").attribute("href", "blogs/", blog.get_id()).text("Read more").end("a");
+        html.start("div").attribute("class", "created-at").text("Published on: ", blog.get_created_at()).end("div");
+        html.end("article");
     }
+    return out;
+}
 
-    auto elms = parse_html_string(html);
+// The article card of an entry, rendered once per published version. Cards are built in code
+// rather than from a template, so they never need rebuilding.
+std::shared_ptr<const std::string> cached_article_card(const BlogEntry &entry)
+{
+    return entry.renderings->get(BlogRenderings::article_card, 0, [&]
+                                 { return article_card_html(*entry.blog); });
+}
 
-    for (auto &elm : elms)
+// A page of the home page. Article cards are rendered once per blog version and kept with the
+// entry, so a page is the cached cards copied back to back.
+std::string index_view(const BlogEntryPage &page)
+{
+    TRACE_SPAN("index_view");
+    std::vector<std::shared_ptr<const std::string>> cards(page.entries.size());
+    size_t estimate = 128;
+    for (size_t i = 0; i < cards.size(); i++)
     {
-        doc.add_child(elm);
-        elm->set_params_recursive({{"articles_html", blogs_elm->to_string()}});
+        cards[i] = cached_article_card(*page.entries[i]);
+        estimate += cards[i]->size();
     }
 
-    return doc.to_string();
+    return template_cache().get("index.html")->render_document_with("articles_html", estimate, [&](std::string &out)
+                                                                    {
+        out += "<main>";
+        for (const auto &card : cards)
+            out += *card;
+        // The listing runs by ascending id, so the next page holds newer posts
+        if (page.next_after >= 0)
+        {
+            HtmlWriter html(out);
+            html.start("a").attribute("href", "/?after=", page.next_after).attribute("class", "pagination").text("Newer posts").end("a");
+        }
+        out += "</main>"; });
 }
 
 std::string admin_login_view()
 {
-    std::string index_path = CPP_PROJECT_SOURCE_DIR + std::string("views/html/admin-login.html");
-
-    std::string html;
-
-    std::ifstream index_file(index_path);
-    if (index_file)
-    {
-        html.assign((std::istreambuf_iterator<char>(index_file)),
-                    (std::istreambuf_iterator<char>()));
-    }
-
-    return html;
+    return template_cache().get("admin-login.html")->get_source();
 }
 
 std::string admin_dashboard_view(const std::vector<Blog> &blogs = {})
 {
-    using namespace hh_html_builder;
-
-    std::string index_path = CPP_PROJECT_SOURCE_DIR + std::string("views/html/admin-dashboard.html");
-
-    std::string html;
-
-    std::ifstream index_file(index_path);
-    if (index_file)
-    {
-        html.assign((std::istreambuf_iterator<char>(index_file)),
-                    (std::istreambuf_iterator<char>()));
-    }
-    document doc;
-
-    element section("section");
-    section.add_child(std::make_shared<element>("h2", "Current Blogs"));
-
-    auto elms = parse_html_string(html);
-
-    element ul("ul");
-
+    TRACE_SPAN("admin_dashboard_view");
+    size_t estimate = 64;
     for (const auto &blog : blogs)
-    {
-        element li("li");
-        li.add_child(std::make_shared<element>("a", "Edit " + blog.get_title(),
-                                               std::map<std::string, std::string>({{"href", "/admin/blogs/" + std::to_string(blog.get_id()) + "/edit"}})));
-        li.add_child(std::make_shared<element>("button", "Delete",
-                                               std::map<std::string, std::string>({{"onclick", "deleteBlog(" + std::to_string(blog.get_id()) + ")"}})));
-        ul.add_child(std::make_shared<element>(li));
-    }
-
-    section.add_child(std::make_shared<element>(ul));
-
-    for (auto &elm : elms)
-    {
-        elm->set_params_recursive({{"current_blogs_html", section.to_string()}});
-        doc.add_child(elm);
-    }
-
-    return doc.to_string();
+        estimate += LIST_ITEM_MARKUP_SIZE + blog.get_title().size();
+
+    return template_cache().get("admin-dashboard.html")->render_document_with("current_blogs_html", estimate, [&](std::string &out)
+                                                                              {
+        HtmlWriter html(out);
+        html.start("section");
+        html.start("h2").text("Current Blogs").end("h2");
+        html.start("ul");
+        for (const auto &blog : blogs)
+        {
+            html.start("li");
+            html.start("a").attribute("href", "/admin/blogs/", blog.get_id(), "/edit").text("Edit ", blog.get_title()).end("a");
+            html.start("button").attribute("onclick", "deleteBlog(", blog.get_id(), ")").text("Delete").end("button");
+            html.end("li");
+        }
+        html.end("ul");
+        html.end("section"); });
 }
 
 std::string admin_edit_blog_view(const Blog &blog)
 {
-    using namespace hh_html_builder;
-
-    document doc;
-
-    std::string index_path = CPP_PROJECT_SOURCE_DIR + std::string("views/html/admin-edit-blog.html");
-
-    std::string html;
-
-    std::ifstream index_file(index_path);
-    if (index_file)
-    {
-        html.assign((std::istreambuf_iterator<char>(index_file)),
-                    (std::istreambuf_iterator<char>()));
-    }
-
-    auto elms = parse_html_string(html);
-
-    for (auto &elm : elms)
-    {
-        elm->set_params_recursive({{"blog_id", std::to_string(blog.get_id())},
-                                   {"blog_title", blog.get_title()},
-                                   {"blog_content", blog.get_content()}});
-        doc.add_child(elm);
-    }
-
-    return doc.to_string();
+    TRACE_SPAN("admin_edit_blog_view");
+    std::string blog_id = std::to_string(blog.get_id());
+    std::string_view blog_title = blog.get_title();
+    std::string_view blog_content = blog.get_content();
+
+    return template_cache().get("admin-edit-blog.html")->render_document({{"blog_id", blog_id},
+                                                                          {"blog_title", blog_title},
+                                                                          {"blog_content", blog_content}});
 }
 
 std::string get_single_blog_view(const Blog &blog)
 {
+    TRACE_SPAN("get_single_blog_view");
+    std::string blog_id = std::to_string(blog.get_id());
+    std::string_view blog_title = blog.get_title();
+    std::string_view blog_content = blog.get_content();
+    std::string_view blog_created_at = blog.get_created_at();
+
+    return template_cache().get("single-blog.html")->render_document({{"blog_id", blog_id},
+                                                                      {"blog_title", blog_title},
+                                                                      {"blog_content", blog_content},
+                                                                      {"blog_created_at", blog_created_at}});
+}
 
-    using namespace hh_html_builder;
-
-    document doc;
-
-    std::string index_path = CPP_PROJECT_SOURCE_DIR + std::string("views/html/single-blog.html");
-
-    std::string html;
-
-    std::ifstream index_file(index_path);
-    if (index_file)
-    {
-        html.assign((std::istreambuf_iterator<char>(index_file)),
-                    (std::istreambuf_iterator<char>()));
-    }
-
-    auto elms = parse_html_string(html);
-    for (auto &elm : elms)
-    {
-        elm->set_params_recursive({{"blog_id", std::to_string(blog.get_id())},
-                                   {"blog_title", blog.get_title()},
-                                   {"blog_content", blog.get_content()},
-                                   {"blog_created_at", blog.get_created_at()}});
-        doc.add_child(elm);
-    }
-
-    return doc.to_string();
+// The page of an entry, rendered once per published version and template generation
+std::shared_ptr<const std::string> cached_blog_page(const BlogEntry &entry)
+{
+    return entry.renderings->get(BlogRenderings::blog_page, template_cache().generation(), [&]
+                                 { return get_single_blog_view(*entry.blog); });
 }
\ No newline at end of file